@@ -0,0 +1,1054 @@
+/*
+ * bench_fault.cc
+ *
+ * Fault-path benchmarks for the pager, driven through the software MMU of
+ * the in-process simulator.  Each benchmark runs in a fresh process of the
+ * pager and reports the cost per fault (or per operation) in nanoseconds.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <algorithm>
+#include <vector>
+#include "vm_pager.h"
+#include "vm_sim.h"
+#include "pager.h"
+#include "lz_page.h"
+
+static unsigned int memory_pages = 1024;
+static unsigned int disk_blocks = 8192;
+static unsigned int rounds = 20;
+static unsigned int threads;            // most threads the scaling benchmark runs
+static pid_t next_pid = 1;
+static std::vector<bool> written;      // pages of the running process written
+
+static double now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// resident set size of the benchmark, in KiB
+static long rss_kb()
+{
+    long size = 0, resident = 0;
+    FILE *f = fopen("/proc/self/statm", "r");
+    if (f != NULL) {
+        if (fscanf(f, "%ld %ld", &size, &resident) != 2)
+            resident = 0;
+        fclose(f);
+    }
+    return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+static void *page_addr(unsigned int page)
+{
+    return (char *) VM_ARENA_BASEADDR + (size_t) page * VM_PAGESIZE;
+}
+
+static void touch(unsigned int page, bool write_flag)
+{
+    char *p = (char *) mmu_translate(page_addr(page), write_flag);
+    if (p == NULL) {
+        fprintf(stderr, "bench_fault: access to page %u refused\n", page);
+        exit(1);
+    }
+    if (write_flag) {
+        *p = (char) page;
+        written[page] = true;
+    } else if (*p != (written[page] ? (char) page : 0)) {
+        fprintf(stderr, "bench_fault: page %u holds the wrong data\n", page);
+        exit(1);
+    }
+}
+
+// write zeros over the page, which the pager may then drop instead of
+// writing it back
+static void clear(unsigned int page)
+{
+    char *p = (char *) mmu_translate(page_addr(page), true);
+    if (p == NULL) {
+        fprintf(stderr, "bench_fault: access to page %u refused\n", page);
+        exit(1);
+    }
+    *p = 0;
+    written[page] = false;
+}
+
+static void start_process(unsigned int pages)
+{
+    vm_create(next_pid);
+    vm_switch(next_pid);
+    next_pid++;
+    written.assign(pages, false);
+    for (unsigned int i = 0; i < pages; i++) {
+        if (vm_extend() == NULL) {
+            fprintf(stderr, "bench_fault: out of swap after %u pages\n", i);
+            exit(1);
+        }
+    }
+}
+
+static void report(const char *name, unsigned long long ops, double ns,
+        unsigned long long reads, unsigned long long writes, unsigned long long requests)
+{
+    printf("%-16s %10llu faults %10.1f ns/fault %10llu disk_read %10llu disk_write %10llu requests\n",
+            name, ops, ops ? ns / ops : 0.0, reads, writes, requests);
+}
+
+/*
+ * Run "body" over a fresh process of "pages" pages and report the faults it
+ * took and the time per fault.
+ */
+static void run(const char *name, unsigned int pages, void (*body)(unsigned int))
+{
+    start_process(pages);
+
+    unsigned long long faults = mmu_faults;
+    unsigned long long reads = disk_reads;
+    unsigned long long writes = disk_writes;
+    unsigned long long requests = disk_requests;
+    unsigned long long fg_writes = pager_totals.fg_writebacks;
+    double start = now_ns();
+    body(pages);
+    double ns = now_ns() - start;
+    report(name, mmu_faults - faults, ns, disk_reads - reads, disk_writes - writes,
+            disk_requests - requests);
+    if (pager_clean_low > 0)
+        printf("%-16s %10llu writes in faults\n", "", pager_totals.fg_writebacks - fg_writes);
+
+    vm_destroy();
+}
+
+// first touch of every page: zero-fill faults, no eviction
+static void zero_fill(unsigned int pages)
+{
+    for (unsigned int i = 0; i < pages; i++)
+        touch(i, true);
+}
+
+// read then write every page: read fault followed by a write (upgrade) fault
+static void read_write(unsigned int pages)
+{
+    for (unsigned int i = 0; i < pages; i++) {
+        touch(i, false);
+        touch(i, true);
+    }
+}
+
+// sequential writes over twice the physical memory: every fault evicts
+static void sweep_write(unsigned int pages)
+{
+    for (unsigned int r = 0; r < rounds; r++)
+        for (unsigned int i = 0; i < pages; i++)
+            touch(i, true);
+}
+
+// sequential reads over twice the physical memory, after one writing pass
+static void sweep_read(unsigned int pages)
+{
+    for (unsigned int i = 0; i < pages; i++)
+        touch(i, true);
+    for (unsigned int r = 0; r < rounds; r++)
+        for (unsigned int i = 0; i < pages; i++)
+            touch(i, false);
+}
+
+// sequential writes of zeros over twice the physical memory, after one
+// pass writing data: every eviction finds an all-zero dirty page
+static void sweep_zero(unsigned int pages)
+{
+    for (unsigned int i = 0; i < pages; i++)
+        touch(i, true);
+    for (unsigned int r = 0; r < rounds; r++)
+        for (unsigned int i = 0; i < pages; i++)
+            clear(i);
+    for (unsigned int i = 0; i < pages; i++)
+        touch(i, false);
+}
+
+// uniformly random reads and writes over twice the physical memory
+static void random_access(unsigned int pages)
+{
+    unsigned int seed = 1;
+    for (unsigned long long n = 0; n < (unsigned long long) rounds * pages; n++)
+        touch(rand_r(&seed) % pages, rand_r(&seed) & 1);
+}
+
+// hot set of half the memory re-used between chunks of a sequential scan
+// over four times the memory: scan-resistant policies keep the hot set
+static void hot_scan(unsigned int pages)
+{
+    unsigned int hot = memory_pages / 2;
+    unsigned int next = hot;
+    for (unsigned int r = 0; r < rounds; r++) {
+        for (unsigned int step = 0; step < 8; step++) {
+            for (unsigned int i = 0; i < hot; i++)
+                touch(i, r == 0 && step == 0);
+            for (unsigned int i = 0; i < memory_pages / 2; i++) {
+                touch(next, true);
+                if (++next == pages)
+                    next = hot;
+            }
+        }
+    }
+}
+
+// sweep_write, but with the pages released after every pass, as a process
+// does with scratch buffers it is done with: nothing is written back
+static void sweep_release(unsigned int pages)
+{
+    for (unsigned int r = 0; r < rounds; r++) {
+        for (unsigned int i = 0; i < pages; i++)
+            touch(i, true);
+        if (vm_release(page_addr(0), pages * VM_PAGESIZE) != 0) {
+            fprintf(stderr, "bench_fault: vm_release failed\n");
+            exit(1);
+        }
+        written.assign(pages, false);
+    }
+}
+
+// hot_scan, with the scanned pages advised sequential: they are dropped
+// behind the scan even by policies that are not scan-resistant
+static void hot_scan_advised(unsigned int pages)
+{
+    unsigned int hot = memory_pages / 2;
+    if (vm_advise(page_addr(hot), (pages - hot) * VM_PAGESIZE, VM_ADVISE_SEQUENTIAL) != 0) {
+        fprintf(stderr, "bench_fault: vm_advise failed\n");
+        exit(1);
+    }
+    hot_scan(pages);
+}
+
+// age the swap device: four processes write their pages in turn, then every
+// other one is destroyed, leaving holes between the blocks of the others
+// (which live on until end_age_swap)
+static pid_t aged_first;
+static const unsigned int aged_procs = 4;
+
+static void age_swap()
+{
+    unsigned int procs = aged_procs;
+    pid_t first = aged_first = next_pid;
+    for (unsigned int p = 0; p < procs; p++) {
+        vm_create(next_pid);
+        vm_switch(next_pid++);
+        for (unsigned int i = 0; i < memory_pages; i++)
+            vm_extend();
+    }
+    for (unsigned int i = 0; i < memory_pages; i++) {
+        for (unsigned int p = 0; p < procs; p++) {
+            vm_switch(first + p);
+            char *data = (char *) mmu_translate(page_addr(i), true);
+            if (data == NULL) {
+                fprintf(stderr, "bench_fault: access to page %u refused\n", i);
+                exit(1);
+            }
+            *data = 1;
+        }
+    }
+    for (unsigned int p = 1; p < procs; p += 2) {
+        vm_switch(first + p);
+        vm_destroy();
+    }
+
+    swap_usage swap = pager_swap_usage();
+    printf("%-16s %10u free   %10u extents %10u largest\n", "aged_swap", swap.free_blocks,
+            swap.extents, swap.largest_extent);
+}
+
+static void end_age_swap()
+{
+    for (unsigned int p = 0; p < aged_procs; p += 2) {
+        vm_switch(aged_first + p);
+        vm_destroy();
+    }
+}
+
+// write "page" of the running process, or read it, without checking its data
+static void access_page(unsigned int page, bool write_flag)
+{
+    char *p = (char *) mmu_translate(page_addr(page), write_flag);
+    if (p == NULL) {
+        fprintf(stderr, "bench_fault: access to page %u refused\n", page);
+        exit(1);
+    }
+    if (write_flag)
+        *p = 1;
+}
+
+// a tenant re-reading a hot set of a quarter of the memory while a
+// neighbour sweeps twice the memory between its passes, without resident
+// set limits and then with the neighbour limited to half the memory and
+// the tenant guaranteed its hot set
+static void noisy_neighbour()
+{
+    unsigned int hot = memory_pages / 4;
+    unsigned int sweep = 2 * memory_pages;
+    for (int limited = 0; limited < 2; limited++) {
+        pid_t tenant = next_pid++;
+        pid_t neighbour = next_pid++;
+        vm_create(tenant);
+        vm_create(neighbour);
+        if (limited) {
+            pager_set_rss_limits(tenant, hot, 0);
+            pager_set_rss_limits(neighbour, 0, memory_pages / 2);
+        }
+        vm_switch(neighbour);
+        for (unsigned int i = 0; i < sweep; i++)
+            vm_extend();
+        vm_switch(tenant);
+        for (unsigned int i = 0; i < hot; i++) {
+            vm_extend();
+            access_page(i, true);
+        }
+
+        pager_stats before, after;
+        pager_process_stats(tenant, &before);
+        unsigned long long faults = 0;
+        double ns = 0;
+        for (unsigned int r = 0; r < rounds; r++) {
+            vm_switch(tenant);
+            unsigned long long f = mmu_faults;
+            double start = now_ns();
+            for (unsigned int i = 0; i < hot; i++)
+                access_page(i, false);
+            ns += now_ns() - start;
+            faults += mmu_faults - f;
+            vm_switch(neighbour);
+            for (unsigned int i = 0; i < sweep; i++)
+                access_page(i, true);
+        }
+        pager_process_stats(tenant, &after);
+        rss_usage rss;
+        pager_process_rss(neighbour, &rss);
+        printf("%-16s %10s limit %10llu faults %10llu major %10.1f ns/read %10u neighbour_rss\n",
+                "noisy_neighbour", limited ? "with" : "no", faults,
+                after.major_faults - before.major_faults, ns / ((double) rounds * hot), rss.resident);
+
+        vm_destroy();
+        vm_switch(tenant);
+        vm_destroy();
+    }
+}
+
+// children forked from a process filling the memory (as many as swap can
+// hold): the cost of vm_fork, then of the children each writing every 8th
+// page (copy on write), and the parent's data checked to be unchanged
+static void fork_cow()
+{
+    unsigned int pages = memory_pages;
+    unsigned int children = std::min(16U, disk_blocks / pages - 1);
+    start_process(pages);
+    pid_t parent = next_pid - 1;
+    for (unsigned int i = 0; i < pages; i++)
+        touch(i, true);
+
+    unsigned long long reads = disk_reads;
+    unsigned long long writes = disk_writes;
+    double start = now_ns();
+    pid_t first = next_pid;
+    for (unsigned int c = 0; c < children; c++) {
+        if (vm_fork(next_pid++) != 0) {
+            fprintf(stderr, "bench_fault: vm_fork failed\n");
+            exit(1);
+        }
+    }
+    double ns = now_ns() - start;
+    printf("%-16s %10u pages  %10.1f ns/fork %10llu disk_read %10llu disk_write\n", "fork", pages,
+            ns / children, disk_reads - reads, disk_writes - writes);
+
+    pager_stats before = pager_total_stats();
+    unsigned long long faults = mmu_faults;
+    start = now_ns();
+    for (pid_t child = first; child < next_pid; child++) {
+        vm_switch(child);
+        for (unsigned int i = 0; i < pages; i += 8)
+            access_page(i, true);
+    }
+    ns = now_ns() - start;
+    pager_stats after = pager_total_stats();
+    printf("%-16s %10llu faults %10.1f ns/fault %10llu copies\n", "cow_write", mmu_faults - faults,
+            (mmu_faults - faults) ? ns / (mmu_faults - faults) : 0.0,
+            after.cow_copies - before.cow_copies);
+
+    // the children see the parent's data where they did not write
+    for (pid_t child = first; child < next_pid; child++) {
+        vm_switch(child);
+        for (unsigned int i = 1; i < pages; i += 8)
+            touch(i, false);
+    }
+    vm_switch(parent);
+    for (unsigned int i = 0; i < pages; i++)
+        touch(i, false);
+
+    for (pid_t child = first; child < next_pid; child++) {
+        vm_switch(child);
+        vm_destroy();
+    }
+    vm_switch(parent);
+    for (unsigned int i = 0; i < pages; i++)
+        touch(i, false);
+    vm_destroy();
+}
+
+// a new process whose arena is the "bench" shared segment of "pages" pages
+static void shm_process(unsigned int pages)
+{
+    vm_create(next_pid);
+    vm_switch(next_pid);
+    next_pid++;
+    if (vm_shm_attach("bench", pages) == NULL) {
+        fprintf(stderr, "bench_fault: vm_shm_attach failed\n");
+        exit(1);
+    }
+}
+
+// a producer handing a buffer of half the memory to three consumers, by
+// copying it into each consumer's arena and then through a shared segment
+// they all attach: the time per page handed over and read, and the
+// evictions and disk traffic of the copies' extra frames
+static void shm_exchange()
+{
+    unsigned int pages = memory_pages / 2;
+    unsigned int consumers = 3;
+    static char copy[VM_PAGESIZE];
+    for (int shared = 0; shared < 2; shared++) {
+        pager_stats before = pager_total_stats();
+        unsigned long long reads = disk_reads;
+        unsigned long long writes = disk_writes;
+        double start = now_ns();
+
+        pid_t producer = next_pid;
+        if (shared)
+            shm_process(pages);
+        else
+            start_process(pages);
+        for (unsigned int i = 0; i < pages; i++)
+            *(char *) mmu_translate(page_addr(i), true) = (char) (i + 1);
+
+        pid_t first = next_pid;
+        for (unsigned int c = 0; c < consumers; c++) {
+            pid_t consumer = next_pid;
+            if (shared) {
+                shm_process(pages);
+                continue;
+            }
+            start_process(pages);
+            for (unsigned int i = 0; i < pages; i++) {
+                vm_switch(producer);
+                memcpy(copy, mmu_translate(page_addr(i), false), VM_PAGESIZE);
+                vm_switch(consumer);
+                memcpy(mmu_translate(page_addr(i), true), copy, VM_PAGESIZE);
+            }
+        }
+        for (pid_t consumer = first; consumer < next_pid; consumer++) {
+            vm_switch(consumer);
+            for (unsigned int i = 0; i < pages; i++) {
+                if (*(char *) mmu_translate(page_addr(i), false) != (char) (i + 1)) {
+                    fprintf(stderr, "bench_fault: page %u of the buffer holds the wrong data\n", i);
+                    exit(1);
+                }
+            }
+        }
+        double ns = now_ns() - start;
+        pager_stats after = pager_total_stats();
+        printf("%-16s %10s %10.1f ns/page %10llu evictions %10llu disk_read %10llu disk_write\n",
+                "shm_exchange", shared ? "shared" : "copied", ns / ((double) pages * consumers),
+                after.evictions - before.evictions, disk_reads - reads, disk_writes - writes);
+
+        if (shared)
+            vm_shm_unlink("bench");
+        for (pid_t pid = producer; pid < next_pid; pid++) {
+            vm_switch(pid);
+            vm_destroy();
+        }
+    }
+}
+
+// three tenants loading the same table of a quarter of the memory each: two
+// passes of the dedup scanner over the memory, the pages it merged and the
+// frames the sharing saves; then the tenants writing every 8th page of
+// their table (copy on write), and all their data checked.  The tenants
+// share a shard (pid modulo pager_shards), as pages only merge within one,
+// and every copy of a page but the first must have been merged.
+static void dedup_merge()
+{
+    unsigned int pages = (memory_pages - pager_zcache_frames) / pager_shards / 4;
+    unsigned int tenants = 3;
+    next_pid += (pager_shards - next_pid % pager_shards) % pager_shards;
+    pid_t first = next_pid;
+    for (unsigned int t = 0; t < tenants; t++) {
+        start_process(pages);
+        next_pid += pager_shards - 1;
+        for (unsigned int i = 0; i < pages; i++)
+            *(char *) mmu_translate(page_addr(i), true) = (char) (i + 1);
+    }
+
+    dedup_usage before = pager_dedup_usage();
+    double start = now_ns();
+    // (a page merges when seen unchanged a second time, into one seen in
+    // the same pass over its shard, and the scanner thread leaves the hand
+    // anywhere: three rounds hold a whole pass after a first sighting)
+    unsigned int merged = pager_dedup_scan(3 * memory_pages);
+    double ns = now_ns() - start;
+    dedup_usage after = pager_dedup_usage();
+    unsigned long long scanned = after.scanned - before.scanned;
+    printf("%-16s %10llu frames %10.1f ns/frame %10u merged %10u saved\n", "dedup_scan", scanned,
+            scanned ? ns / scanned : 0.0, merged, after.saved_frames);
+    // (all-zero pages are left alone; the scanner thread may have merged
+    // some of the pages already)
+    unsigned int expect = 0;
+    for (unsigned int i = 0; i < pages; i++)
+        expect += (char) (i + 1) != 0 ? tenants - 1 : 0;
+    if (after.saved_frames < expect || after.merged - before.merged + merged == 0) {
+        fprintf(stderr, "bench_fault: dedup saved %u frames of %u identical pages\n",
+                after.saved_frames, expect);
+        exit(1);
+    }
+
+    pager_stats stats = pager_total_stats();
+    unsigned long long faults = mmu_faults;
+    start = now_ns();
+    for (pid_t tenant = first; tenant < next_pid; tenant += pager_shards) {
+        vm_switch(tenant);
+        for (unsigned int i = 0; i < pages; i += 8)
+            *(char *) mmu_translate(page_addr(i), true) = (char) (i + 2);
+    }
+    ns = now_ns() - start;
+    printf("%-16s %10llu faults %10.1f ns/fault %10llu copies\n", "dedup_cow", mmu_faults - faults,
+            (mmu_faults - faults) ? ns / (mmu_faults - faults) : 0.0,
+            pager_total_stats().cow_copies - stats.cow_copies);
+
+    for (pid_t tenant = first; tenant < next_pid; tenant += pager_shards) {
+        vm_switch(tenant);
+        for (unsigned int i = 0; i < pages; i++) {
+            if (*(char *) mmu_translate(page_addr(i), false) != (char) (i % 8 ? i + 1 : i + 2)) {
+                fprintf(stderr, "bench_fault: page %u of a merged table holds the wrong data\n", i);
+                exit(1);
+            }
+        }
+    }
+    for (pid_t tenant = first; tenant < next_pid; tenant += pager_shards) {
+        vm_switch(tenant);
+        vm_destroy();
+    }
+}
+
+// fill page "page" with numbered lines of text naming it, which compress
+// well but not to nothing
+static void fill_text(char *p, unsigned int page)
+{
+    static char text[VM_PAGESIZE];
+    if (text[0] == '\0') {
+        char line[64];
+        for (unsigned int off = 0; off < VM_PAGESIZE; off += 32) {
+            snprintf(line, sizeof(line), "page %8u line %4u ......\n", 0, off / 32);
+            memcpy(text + off, line, 32);
+        }
+    }
+    char name[16];
+    snprintf(name, sizeof(name), "%8u", page % 100000000);
+    memcpy(p, text, VM_PAGESIZE);
+    for (unsigned int off = 0; off < VM_PAGESIZE; off += 32)
+        memcpy(p + off + 5, name, 8);
+}
+
+// a process of twice the memory writing text into every page, then reading
+// it all back twice: the time per fault, the evicted pages found in the
+// compressed swap cache (hit rate over those and the pages read from disk)
+
+// compress "page" with room for "cap" bytes and check the result: 0 only if
+// the page does not fit in cap, else a length within it that decompresses
+// back to the page, and is refused if cut short.  Returns the length.
+static unsigned int lz_check(const char *page, unsigned int cap, const char *what)
+{
+    static char out[VM_PAGESIZE + VM_PAGESIZE / 2];
+    static char whole[VM_PAGESIZE + VM_PAGESIZE / 2];
+    static char back[VM_PAGESIZE];
+    unsigned int length = lz_compress(page, out, cap);
+    unsigned int full = lz_compress(page, whole, sizeof(whole));
+    // the room checks count the length bytes of a sequence generously, so a
+    // page that would fit within a few bytes of cap may still be refused
+    bool ok = full > 0 && (length == 0 ? full + 8 > cap : length <= cap && length == full);
+    if (ok && length > 0) {
+        ok = lz_decompress(out, length, back) && memcmp(back, page, VM_PAGESIZE) == 0
+                && !lz_decompress(out, length - 1, back);
+    }
+    if (!ok) {
+        fprintf(stderr, "bench_fault: lz_page round trip of %s failed (%u bytes of %u)\n",
+                what, length, cap);
+        exit(1);
+    }
+    return length;
+}
+
+// the codec on its own: all-zero, text and random pages, and pages of a
+// random run followed by zeros whose compressed size sweeps across the
+// cache's bound of 3/4 of a page
+static void lz_roundtrip()
+{
+    static char page[VM_PAGESIZE];
+    const unsigned int bound = VM_PAGESIZE / 4 * 3;
+    unsigned int checked = 0;
+    unsigned int fits = 0;
+
+    memset(page, 0, VM_PAGESIZE);
+    if (lz_check(page, bound, "a zero page") == 0) {
+        fprintf(stderr, "bench_fault: lz_page does not compress a zero page\n");
+        exit(1);
+    }
+    fill_text(page, 7);
+    lz_check(page, bound, "a text page");
+    uint32_t x = 2463534242u;
+    for (unsigned int i = 0; i < VM_PAGESIZE; i++) {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        page[i] = (char) x;
+    }
+    if (lz_check(page, bound, "a random page") != 0) {
+        fprintf(stderr, "bench_fault: lz_page compresses a random page\n");
+        exit(1);
+    }
+    lz_check(page, VM_PAGESIZE + VM_PAGESIZE / 2, "a random page");
+    checked = 4;
+    for (unsigned int run = bound - 128; run <= bound; run++) {
+        static char mixed[VM_PAGESIZE];
+        memcpy(mixed, page, run);
+        memset(mixed + run, 0, VM_PAGESIZE - run);
+        if (lz_check(mixed, bound, "a page near the bound") != 0)
+            fits++;
+        checked++;
+    }
+    if (fits == 0 || fits == checked - 4) {
+        fprintf(stderr, "bench_fault: lz_page pages near the bound all %s\n",
+                fits ? "fit" : "miss");
+        exit(1);
+    }
+    printf("%-16s %10u pages %10u near the bound fit\n", "lz_roundtrip", checked, fits);
+}
+// and its compression ratio, and the disk traffic left.
+static void zcache_swap()
+{
+    unsigned int pages = 2 * memory_pages;
+    static char expect[VM_PAGESIZE];
+    lz_roundtrip();
+    start_process(pages);
+    pager_stats before = pager_total_stats();
+    unsigned long long faults = mmu_faults;
+    unsigned long long reads = disk_reads;
+    unsigned long long writes = disk_writes;
+    double start = now_ns();
+    for (unsigned int i = 0; i < pages; i++)
+        fill_text((char *) mmu_translate(page_addr(i), true), i);
+    for (unsigned int r = 0; r < 2; r++) {
+        for (unsigned int i = 0; i < pages; i++) {
+            fill_text(expect, i);
+            if (memcmp(mmu_translate(page_addr(i), false), expect, VM_PAGESIZE) != 0) {
+                fprintf(stderr, "bench_fault: page %u of the text holds the wrong data\n", i);
+                exit(1);
+            }
+        }
+    }
+    double ns = now_ns() - start;
+    pager_stats after = pager_total_stats();
+    faults = mmu_faults - faults;
+    unsigned long long hits = after.zcache_hits - before.zcache_hits;
+    unsigned long long stores = after.zcache_stores - before.zcache_stores;
+    unsigned long long bytes = after.zcache_bytes - before.zcache_bytes;
+    printf("%-16s %10llu faults %10.1f ns/fault %10llu hits %8.1f %% hits %6.2f ratio %10llu disk_read %10llu disk_write\n",
+            "zcache_swap", faults, faults ? ns / faults : 0.0, hits,
+            hits + disk_reads - reads ? 100.0 * hits / (hits + disk_reads - reads) : 0.0,
+            bytes ? (double) stores * VM_PAGESIZE / bytes : 0.0, disk_reads - reads, disk_writes - writes);
+    vm_destroy();
+}
+
+// cost of vm_create + vm_extend of 16 pages + vm_destroy, of tearing down a
+// resident process, and of growing an arena
+static void lifecycle()
+{
+    unsigned int count = 1000;
+    long rss = rss_kb();
+    double start = now_ns();
+    for (unsigned int i = 0; i < count; i++) {
+        start_process(16);
+        vm_destroy();
+    }
+    double ns = now_ns() - start;
+    printf("%-16s %10u procs  %10.1f ns/proc %10ld KiB rss growth\n", "create_destroy", count,
+            ns / count, rss_kb() - rss);
+    if (pager_page_tables != 0) {
+        fprintf(stderr, "bench_fault: %u page tables leaked\n", pager_page_tables);
+        exit(1);
+    }
+
+    // tear down a process that fills physical memory
+    start_process(memory_pages);
+    zero_fill(memory_pages);
+    start = now_ns();
+    vm_destroy();
+    ns = now_ns() - start;
+    printf("%-16s %10u pages  %10.1f ns/page\n", "destroy_resident", memory_pages, ns / memory_pages);
+
+    // grow an arena to all the swap there is, a page per call and in one call
+    for (int batched = 0; batched < 2; batched++) {
+        vm_create(next_pid);
+        vm_switch(next_pid);
+        next_pid++;
+        start = now_ns();
+        bool grown = true;
+        if (batched) {
+            grown = vm_extend_n(disk_blocks) != NULL;
+        } else {
+            for (unsigned int i = 0; i < disk_blocks && grown; i++)
+                grown = vm_extend() != NULL;
+        }
+        ns = now_ns() - start;
+        if (!grown) {
+            fprintf(stderr, "bench_fault: cannot grow an arena to %u pages\n", disk_blocks);
+            exit(1);
+        }
+        printf("%-16s %10u pages  %10.1f ns/page\n", batched ? "extend_n" : "extend", disk_blocks,
+                ns / disk_blocks);
+        vm_destroy();
+    }
+}
+
+// cost of vm_switch between random processes, as the number of live
+// processes grows
+static void switch_cost()
+{
+    unsigned int switches = 1000000;
+    std::vector<pid_t> order(switches);
+    for (unsigned int live = 10; live <= 100000; live *= 10) {
+        pid_t first = next_pid;
+        for (unsigned int i = 0; i < live; i++)
+            vm_create(next_pid++);
+
+        unsigned int seed = 1;
+        for (unsigned int i = 0; i < switches; i++)
+            order[i] = first + rand_r(&seed) % live;
+        double start = now_ns();
+        for (unsigned int i = 0; i < switches; i++)
+            vm_switch(order[i]);
+        double ns = now_ns() - start;
+        printf("%-16s %10u procs  %10.1f ns/switch\n", "switch", live, ns / switches);
+
+        for (pid_t pid = first; pid < next_pid; pid++) {
+            vm_switch(pid);
+            vm_destroy();
+        }
+    }
+}
+
+struct scaling_job {
+    pid_t pid;
+    unsigned int pages;
+};
+
+// one thread of the scaling benchmark: sweeps over its own process, writing
+// and then reading every page, and checks what it reads.  The accesses go
+// through mmu_read and mmu_write, as another thread may evict the page.
+static void *scaling_thread(void *arg)
+{
+    scaling_job *job = (scaling_job *) arg;
+    vm_create(job->pid);
+    vm_switch(job->pid);
+    for (unsigned int i = 0; i < job->pages; i++) {
+        if (vm_extend() == NULL) {
+            fprintf(stderr, "bench_fault: out of swap after %u pages\n", i);
+            exit(1);
+        }
+    }
+    for (unsigned int r = 0; r < rounds; r++) {
+        bool write_flag = r % 2 == 0;
+        for (unsigned int i = 0; i < job->pages; i++) {
+            char expect = (char) (job->pid * 31 + i + r / 2);
+            char c = expect;
+            if ((write_flag ? mmu_write(page_addr(i), &c, 1) : mmu_read(page_addr(i), &c, 1)) != 0) {
+                fprintf(stderr, "bench_fault: access to page %u refused\n", i);
+                exit(1);
+            }
+            if (c != expect) {
+                fprintf(stderr, "bench_fault: page %u of process %d lost its data\n", i,
+                        (int) job->pid);
+                exit(1);
+            }
+        }
+    }
+    vm_destroy();
+    return NULL;
+}
+
+// 1, 2, 4, ... up to "threads" threads, each faulting on its own process of
+// twice physical memory.  Reports the wall time per fault over all threads
+// and the speedup in faults per second over one thread.
+static void scaling()
+{
+    double single = 0;
+    for (unsigned int n = 1; n <= threads; n = (n * 2 > threads && n < threads) ? threads : n * 2) {
+        std::vector<pthread_t> tids(n);
+        std::vector<scaling_job> jobs(n);
+        unsigned long long faults = mmu_faults;
+        unsigned long long requests = disk_requests;
+        double start = now_ns();
+        for (unsigned int t = 0; t < n; t++) {
+            jobs[t].pid = next_pid++;
+            jobs[t].pages = 2 * memory_pages;
+            if (pthread_create(&tids[t], NULL, scaling_thread, &jobs[t]) != 0) {
+                fprintf(stderr, "bench_fault: cannot start thread\n");
+                exit(1);
+            }
+        }
+        for (unsigned int t = 0; t < n; t++)
+            pthread_join(tids[t], NULL);
+        double ns = now_ns() - start;
+
+        faults = mmu_faults - faults;
+        double per_fault = faults ? ns / faults : 0.0;
+        if (n == 1)
+            single = per_fault;
+        printf("%-16s %10u threads %10.1f ns/fault %10llu requests %10.2f speedup\n", "scaling",
+                n, per_fault, disk_requests - requests, per_fault > 0 ? single / per_fault : 0.0);
+    }
+}
+
+// warm restart (-S state_file): a pager writes restart_procs processes of
+// half the memory each and is killed after a checkpoint, then two more
+// pagers resume them from the state file and the disk left behind, the
+// second warming up the pages the first had resident.  Each pager runs in
+// a child process of its own; the last two check every page and report
+// the time vm_init took to resume, and the faults of a first pass over the
+// process the previous pager used last.
+static const char *state_path;
+static char disk_path[4096];
+static const unsigned int restart_procs = 4;
+
+static char restart_byte(pid_t pid, unsigned int page)
+{
+    return (char) (page * 7 + pid);
+}
+
+static double start_pager(bool warm)
+{
+    pm_init(memory_pages);
+    disk_open(disk_path, disk_blocks);
+    pager_state = state_path;
+    pager_warm = warm;
+    double start = now_ns();
+    vm_init(memory_pages, disk_blocks);
+    return now_ns() - start;
+}
+
+static void read_process(pid_t pid)
+{
+    vm_switch(pid);
+    for (unsigned int i = 0; i < memory_pages / 2; i++) {
+        char *p = (char *) mmu_translate(page_addr(i), false);
+        if (p == NULL || *p != restart_byte(pid, i)) {
+            fprintf(stderr, "bench_fault: page %u of process %d lost in the restart\n", i, pid);
+            exit(1);
+        }
+    }
+}
+
+static void write_and_crash()
+{
+    start_pager(false);
+    for (pid_t pid = 1; pid <= (pid_t) restart_procs; pid++) {
+        vm_create(pid);
+        vm_switch(pid);
+        if (vm_extend_n(memory_pages / 2) == NULL) {
+            fprintf(stderr, "bench_fault: out of swap\n");
+            exit(1);
+        }
+        for (unsigned int i = 0; i < memory_pages / 2; i++)
+            *(char *) mmu_translate(page_addr(i), true) = restart_byte(pid, i);
+    }
+    unsigned long long writes = disk_writes;
+    double start = now_ns();
+    if (!pager_checkpoint()) {
+        fprintf(stderr, "bench_fault: checkpoint failed\n");
+        exit(1);
+    }
+    double ns = now_ns() - start;
+    printf("%-16s %10u procs  %10.1f us     %10llu disk_write\n", "checkpoint", restart_procs,
+            ns / 1000, disk_writes - writes);
+}
+
+static void restart(bool warm)
+{
+    double init_ns = start_pager(warm);
+    restore_usage u = pager_restore_usage();
+    printf("%-16s %10u procs  %10.1f us     %10u pages\n", warm ? "resume_warm" : "resume_cold",
+            u.processes, init_ns / 1000, u.pages);
+    if (u.processes != restart_procs) {
+        fprintf(stderr, "bench_fault: %u of %u processes resumed\n", u.processes, restart_procs);
+        exit(1);
+    }
+    double start = now_ns();
+    while (warm && pager_restore_usage().warming)
+        usleep(100);
+    double warm_ns = now_ns() - start;
+
+    // the previous pager read process 1 last (and the first wrote the last)
+    pid_t hot = warm ? 1 : restart_procs;
+    unsigned long long faults = mmu_faults;
+    unsigned long long reads = disk_reads;
+    start = now_ns();
+    read_process(hot);
+    double ns = now_ns() - start;
+    faults = mmu_faults - faults;
+    printf("%-16s %10llu faults %10.1f ns/fault %10llu disk_read %10u warm_pages %8.1f us warm-up\n",
+            warm ? "restart_warm" : "restart_cold", faults, faults ? ns / faults : 0.0,
+            disk_reads - reads, pager_restore_usage().warm_pages, warm_ns / 1000);
+    for (pid_t pid = 1; pid <= (pid_t) restart_procs; pid++)
+        if (pid != hot)
+            read_process(pid);
+    read_process(1);
+}
+
+static void run_child(void (*body)())
+{
+    fflush(stdout);
+    pid_t child = fork();
+    if (child < 0) {
+        perror("bench_fault: fork");
+        exit(1);
+    }
+    if (child == 0) {
+        body();
+        fflush(stdout);
+        // no vm_destroy: the pager goes down with its processes still live
+        _exit(0);
+    }
+    int status;
+    if (waitpid(child, &status, 0) != child || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        exit(1);
+}
+
+static void restart_cold()
+{
+    restart(false);
+}
+
+static void restart_warm()
+{
+    restart(true);
+}
+
+static void warm_restart()
+{
+    snprintf(disk_path, sizeof(disk_path), "%s.disk", state_path);
+    unlink(state_path);
+    unlink(disk_path);
+    printf("memory_pages %u disk_blocks %u policy %s state %s\n", memory_pages, disk_blocks,
+            pager_policy ? pager_policy : "clock", state_path);
+    run_child(write_and_crash);
+    run_child(restart_cold);
+    run_child(restart_warm);
+}
+
+int main(int argc, char **argv)
+{
+    int c;
+    while ((c = getopt(argc, argv, "m:d:p:w:k:z:r:t:e:S:")) != -1) {
+        switch (c) {
+        case 'm':
+            memory_pages = strtoul(optarg, NULL, 0);
+            break;
+        case 'd':
+            disk_blocks = strtoul(optarg, NULL, 0);
+            break;
+        case 'p':
+            pager_policy = optarg;
+            break;
+        case 'w':
+            pager_clean_low = strtoul(optarg, NULL, 0);
+            break;
+        case 'k':
+            pager_dedup_pages = strtoul(optarg, NULL, 0);
+            break;
+        case 'z':
+            pager_zcache_frames = strtoul(optarg, NULL, 0);
+            break;
+        case 'r':
+            rounds = strtoul(optarg, NULL, 0);
+            break;
+        case 't':
+            threads = strtoul(optarg, NULL, 0);
+            pager_threads = threads;
+            break;
+        case 'e':
+            pager_events = optarg;
+            break;
+        case 'S':
+            state_path = optarg;
+            break;
+        default:
+            fprintf(stderr, "Usage: bench_fault [-m memory_pages] [-d disk_blocks] [-p policy] [-w clean_low] [-k dedup_pages] [-z zcache_frames] [-r rounds] [-t threads] [-e events_file] [-S state_file]\n");
+            exit(1);
+        }
+    }
+    if (memory_pages < 2 || disk_blocks < 4 * memory_pages) {
+        fprintf(stderr, "bench_fault: need at least 2 memory pages and four times as many disk blocks\n");
+        exit(1);
+    }
+    if (disk_blocks < 2 * memory_pages * threads) {
+        fprintf(stderr, "bench_fault: -t %u needs %u disk blocks\n", threads, 2 * memory_pages * threads);
+        exit(1);
+    }
+
+    if (state_path != NULL) {
+        warm_restart();
+        return 0;
+    }
+
+    pm_init(memory_pages);
+    disk_init(disk_blocks);
+    long rss_before = rss_kb();
+    double start = now_ns();
+    vm_init(memory_pages, disk_blocks);
+    double init_ns = now_ns() - start;
+
+    printf("memory_pages %u disk_blocks %u rounds %u policy %s clean_low %u dedup_pages %u zcache_frames %u threads %u events %s\n",
+            memory_pages, disk_blocks, rounds, pager_policy ? pager_policy : "clock",
+            pager_clean_low, pager_dedup_pages, pager_zcache_frames, pager_threads,
+            pager_events ? pager_events : "none");
+    printf("%-16s %10.1f us        %10ld KiB rss\n", "vm_init", init_ns / 1000,
+            rss_kb() - rss_before);
+    run("zero_fill", memory_pages, zero_fill);
+    run("read_write", memory_pages, read_write);
+    run("sweep_write", 2 * memory_pages, sweep_write);
+    run("sweep_read", 2 * memory_pages, sweep_read);
+    run("sweep_zero", 2 * memory_pages, sweep_zero);
+    run("random", 2 * memory_pages, random_access);
+    run("sweep_release", 2 * memory_pages, sweep_release);
+    run("hot_scan", 4 * memory_pages, hot_scan);
+    run("hot_scan_seq", 4 * memory_pages, hot_scan_advised);
+    age_swap();
+    run("aged_sweep_read", 2 * memory_pages, sweep_read);
+    end_age_swap();
+    noisy_neighbour();
+    fork_cow();
+    shm_exchange();
+    dedup_merge();
+    zcache_swap();
+    // (their millions of switches would push the faults out of the event ring)
+    if (pager_events == NULL) {
+        lifecycle();
+        switch_cost();
+    }
+    if (threads > 0)
+        scaling();
+    pager_shutdown();
+    return 0;
+}
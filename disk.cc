@@ -0,0 +1,135 @@
+/*
+ * disk.cc
+ *
+ * Raw disk for the in-process simulator.  Blocks are VM_PAGESIZE bytes and
+ * are transferred to and from physical memory pages.
+ */
+
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <iostream>
+#include <limits.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include "vm_pager.h"
+#include "vm_sim.h"
+
+using namespace std;
+
+static int disk_fd = -1;
+static unsigned int num_disk_blocks;
+
+unsigned long long disk_reads;
+unsigned long long disk_writes;
+unsigned long long disk_requests;
+
+void disk_init(unsigned int blocks)
+{
+    assert(blocks > 0);
+
+    const char *dir = getenv("TMPDIR");
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/vm_disk.XXXXXX", dir ? dir : "/tmp");
+
+    disk_fd = mkstemp(path);
+    if (disk_fd < 0 || ftruncate(disk_fd, (off_t) blocks * VM_PAGESIZE) < 0) {
+        perror("opening disk file");
+        exit(1);
+    }
+    unlink(path);
+    num_disk_blocks = blocks;
+}
+
+void disk_open(const char *path, unsigned int blocks)
+{
+    assert(blocks > 0);
+
+    disk_fd = open(path, O_RDWR | O_CREAT, 0600);
+    if (disk_fd < 0 || ftruncate(disk_fd, (off_t) blocks * VM_PAGESIZE) < 0) {
+        perror("opening disk file");
+        exit(1);
+    }
+    num_disk_blocks = blocks;
+}
+
+static void disk_rdwr(unsigned int block, unsigned int ppage, bool write_flag)
+{
+    assert(disk_fd >= 0);
+    assert(block < num_disk_blocks);
+    assert(ppage < pm_pages);
+
+    // positioned I/O, so the pager's cleaner thread can write while a
+    // fault reads
+    char *data = (char *) pm_physmem + (size_t) ppage * VM_PAGESIZE;
+    off_t offset = (off_t) block * VM_PAGESIZE;
+    ssize_t n = write_flag ? pwrite(disk_fd, data, VM_PAGESIZE, offset)
+                           : pread(disk_fd, data, VM_PAGESIZE, offset);
+    if (n != VM_PAGESIZE) {
+        perror("disk_read or disk_write failed");
+        cerr << "\tblock 0x" << hex << block << "\tppage 0x" << ppage << dec << endl;
+        exit(1);
+    }
+}
+
+void disk_read(unsigned int block, unsigned int ppage)
+{
+    __atomic_add_fetch(&disk_reads, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&disk_requests, 1, __ATOMIC_RELAXED);
+    disk_rdwr(block, ppage, false);
+}
+
+void disk_write(unsigned int block, unsigned int ppage)
+{
+    __atomic_add_fetch(&disk_writes, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&disk_requests, 1, __ATOMIC_RELAXED);
+    disk_rdwr(block, ppage, true);
+}
+
+// one preadv/pwritev of the blocks vec[0].block .. vec[0].block + count - 1
+static void disk_rdwr_run(const disk_iovec_t *vec, unsigned int count, bool write_flag)
+{
+    struct iovec iov[IOV_MAX];
+    for (unsigned int i = 0; i < count; i++) {
+        assert(vec[i].block < num_disk_blocks);
+        assert(vec[i].ppage < pm_pages);
+        iov[i].iov_base = (char *) pm_physmem + (size_t) vec[i].ppage * VM_PAGESIZE;
+        iov[i].iov_len = VM_PAGESIZE;
+    }
+
+    off_t offset = (off_t) vec[0].block * VM_PAGESIZE;
+    ssize_t n = write_flag ? pwritev(disk_fd, iov, count, offset)
+                           : preadv(disk_fd, iov, count, offset);
+    if (n != (ssize_t) count * VM_PAGESIZE) {
+        perror("disk_readv or disk_writev failed");
+        cerr << "\tblock 0x" << hex << vec[0].block << "\tcount " << dec << count << endl;
+        exit(1);
+    }
+    __atomic_add_fetch(&disk_requests, 1, __ATOMIC_RELAXED);
+}
+
+static void disk_rdwrv(const disk_iovec_t *vec, unsigned int count, bool write_flag)
+{
+    assert(disk_fd >= 0);
+
+    unsigned int start = 0;
+    for (unsigned int i = 1; i <= count; i++) {
+        if (i == count || vec[i].block != vec[i - 1].block + 1 || i - start == IOV_MAX) {
+            disk_rdwr_run(vec + start, i - start, write_flag);
+            start = i;
+        }
+    }
+}
+
+void disk_readv(const disk_iovec_t *vec, unsigned int count)
+{
+    __atomic_add_fetch(&disk_reads, count, __ATOMIC_RELAXED);
+    disk_rdwrv(vec, count, false);
+}
+
+void disk_writev(const disk_iovec_t *vec, unsigned int count)
+{
+    __atomic_add_fetch(&disk_writes, count, __ATOMIC_RELAXED);
+    disk_rdwrv(vec, count, true);
+}
@@ -0,0 +1,174 @@
+/*
+ * event_log.h
+ *
+ * Flight recorder for the pager: timestamped events (faults, evictions,
+ * disk requests, switches, syslogs) in a fixed-size ring that threads append
+ * to without a lock, the newest events overwriting the oldest.  The ring is
+ * saved to a file (event_file_header followed by the events, oldest first)
+ * that build/events turns into a Chrome trace and latency histograms.
+ *
+ * Timestamps are TSC ticks on x86 and nanoseconds elsewhere; the header
+ * carries two (tick, nanosecond) pairs to convert them.
+ */
+
+#ifndef _EVENT_LOG_H_
+#define _EVENT_LOG_H_
+
+#include <stdint.h>
+#include <sys/mman.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#define EVENT_MAGIC   "VMEVENT"
+#define EVENT_VERSION 1
+
+enum event_type {
+    EVENT_FAULT = 1,    // vpn; detail: fault kind, EVENT_WRITE if a write
+    EVENT_EVICT,        // victim's pid and vpn; detail: eviction path
+    EVENT_DISK_READ,    // first block; detail: blocks
+    EVENT_DISK_WRITE,   // first block; detail: blocks
+    EVENT_SWITCH,       // instant
+    EVENT_SYSLOG,       // arg: length
+};
+
+enum event_fault_kind {
+    FAULT_MINOR,        // page was resident
+    FAULT_MAJOR,        // read from disk
+    FAULT_ZERO,         // filled with zeros
+    FAULT_REFUSED,      // vm_fault returned -1
+};
+#define EVENT_WRITE 0x80
+
+enum event_evict_path {
+    EVICT_CLEAN,        // no write-back needed
+    EVICT_DIRTY,        // written back with its cluster
+    EVICT_ZERO,         // dirty but all zeros, dropped
+    EVICT_FULL,         // needed a disk block and none was free
+    EVICT_BUSY,         // victim was being written by another thread, waited
+    EVICT_COMPRESSED,   // dirty, compressed into the swap cache
+};
+
+struct pager_event {
+    uint64_t seq;           // index of the event + 1 once complete, else 0
+    uint64_t start;         // clock ticks
+    uint32_t ticks;         // duration, saturated; 0 for an instant event
+    uint32_t pid;
+    uint32_t arg;
+    uint8_t type;
+    uint8_t detail;
+    uint16_t thread;        // small number identifying the recording thread
+};
+
+struct event_file_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t count;         // events following the header
+    uint64_t ticks0, ns0;   // clock at the start of recording, and at the
+    uint64_t ticks1, ns1;   // save: ticks per ns is their slope
+    uint64_t lost;          // events overwritten before the save
+};
+
+inline uint64_t event_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+inline uint64_t event_clock()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return event_ns();
+#endif
+}
+
+class event_ring {
+public:
+    event_ring() : slots(NULL), mask(0), head(0)
+    {
+    }
+
+    // allocate room for 2^order events; recording starts now
+    bool init(unsigned int order)
+    {
+        size_t size = ((size_t) 1 << order) * sizeof(pager_event);
+        void* p = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (p == MAP_FAILED)
+            return false;
+        slots = (pager_event*) p;
+        mask = ((uint64_t) 1 << order) - 1;
+        head = 0;
+        ticks0 = event_clock();
+        ns0 = event_ns();
+        return true;
+    }
+
+    bool enabled() const
+    {
+        return slots != NULL;
+    }
+
+    void record(uint8_t type, uint8_t detail, uint32_t pid, uint32_t arg,
+            uint64_t start, uint64_t end, uint16_t thread)
+    {
+        uint64_t i = __atomic_fetch_add(&head, 1, __ATOMIC_RELAXED);
+        pager_event& e = slots[i & mask];
+        __atomic_store_n(&e.seq, 0, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+        e.start = start;
+        e.ticks = end - start > UINT32_MAX ? UINT32_MAX : end - start;
+        e.pid = pid;
+        e.arg = arg;
+        e.type = type;
+        e.detail = detail;
+        e.thread = thread;
+        __atomic_store_n(&e.seq, i + 1, __ATOMIC_RELEASE);
+    }
+
+    // copy the complete events, oldest first, into "out" (room for
+    // capacity()), filling in the header; returns the number copied
+    uint32_t snapshot(pager_event* out, event_file_header* h) const
+    {
+        uint64_t end = __atomic_load_n(&head, __ATOMIC_ACQUIRE);
+        uint64_t begin = end > mask + 1 ? end - (mask + 1) : 0;
+        uint32_t n = 0;
+        for (uint64_t i = begin; i < end; i++) {
+            const pager_event& e = slots[i & mask];
+            if (__atomic_load_n(&e.seq, __ATOMIC_ACQUIRE) != i + 1)
+                continue;
+            out[n] = e;
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            if (__atomic_load_n(&e.seq, __ATOMIC_RELAXED) == i + 1)
+                n++;
+        }
+        for (int k = 0; k < 8; k++)
+            h->magic[k] = EVENT_MAGIC[k];
+        h->version = EVENT_VERSION;
+        h->count = n;
+        h->ticks0 = ticks0;
+        h->ns0 = ns0;
+        h->ticks1 = event_clock();
+        h->ns1 = event_ns();
+        h->lost = end - n;
+        return n;
+    }
+
+    size_t capacity() const
+    {
+        return mask + 1;
+    }
+
+private:
+    pager_event* slots;
+    uint64_t mask;
+    uint64_t head;          // index of the next event
+    uint64_t ticks0, ns0;
+};
+
+#endif /* _EVENT_LOG_H_ */
@@ -0,0 +1,286 @@
+/*
+ * events.cc
+ *
+ * Read the events the pager recorded (pager_events, see event_log.h) and
+ * report latency percentiles and a histogram of fault times, by fault kind,
+ * by eviction path, by disk request and by process.  With -c, also write
+ * the events as a Chrome trace (JSON, for chrome://tracing or Perfetto),
+ * one track per pager thread, evictions and disk requests nested in the
+ * faults that made them.
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <map>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+#include "event_log.h"
+
+using namespace std;
+
+static const char *fault_kinds[] = { "minor", "major", "zero", "refused" };
+static const char *evict_paths[] = { "clean", "dirty", "zero", "full", "busy", "compressed" };
+static const char *type_names[] = { "", "fault", "evict", "disk_read", "disk_write", "switch", "syslog" };
+
+static double ns_per_tick;
+static uint64_t first_tick;
+
+static void Usage()
+{
+    fprintf(stderr, "Usage: events [-c chrome_trace] [-n processes] events_file\n");
+    exit(1);
+}
+
+static double duration_ns(const pager_event &e)
+{
+    return e.ticks * ns_per_tick;
+}
+
+static double start_us(const pager_event &e)
+{
+    return (e.start - first_tick) * ns_per_tick / 1e3;
+}
+
+// durations of one kind of event, in ns
+struct latencies {
+    vector<double> ns;
+
+    void add(double t)
+    {
+        ns.push_back(t);
+    }
+
+    double percentile(double p) const
+    {
+        return ns[min(ns.size() - 1, (size_t) (p * ns.size()))];
+    }
+
+    void print(const char *name)
+    {
+        if (ns.empty())
+            return;
+        sort(ns.begin(), ns.end());
+        double sum = 0;
+        for (size_t i = 0; i < ns.size(); i++)
+            sum += ns[i];
+        printf("%-18s %10zu %10.1f %10.1f %10.1f %10.1f %10.1f %10.1f\n", name, ns.size(),
+               sum / ns.size() / 1e3, percentile(0.5) / 1e3, percentile(0.9) / 1e3,
+               percentile(0.99) / 1e3, percentile(0.999) / 1e3, ns.back() / 1e3);
+    }
+};
+
+static void print_heading(const char *what)
+{
+    printf("\n%-18s %10s %10s %10s %10s %10s %10s %10s\n", what, "count", "mean_us",
+           "p50_us", "p90_us", "p99_us", "p99.9_us", "max_us");
+}
+
+// power-of-two histogram of fault times, from 1 us
+static void print_histogram(const vector<double> &ns)
+{
+    vector<size_t> buckets;
+    for (size_t i = 0; i < ns.size(); i++) {
+        size_t b = 0;
+        while (ns[i] >= 1e3 * ((size_t) 1 << b))
+            b++;
+        if (b >= buckets.size())
+            buckets.resize(b + 1, 0);
+        buckets[b]++;
+    }
+    size_t most = buckets.empty() ? 0 : *max_element(buckets.begin(), buckets.end());
+    printf("\nfault time\n");
+    for (size_t b = 0; b < buckets.size(); b++) {
+        printf("< %8zu us %10zu  ", (size_t) 1 << b, buckets[b]);
+        for (size_t k = 0; most > 0 && k < buckets[b] * 50 / most; k++)
+            putchar('#');
+        putchar('\n');
+    }
+}
+
+static void write_chrome(const char *path, const pager_event *events, uint32_t count)
+{
+    FILE *f = fopen(path, "w");
+    if (f == NULL) {
+        perror(path);
+        exit(1);
+    }
+    fprintf(f, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    fprintf(f, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"pager\"}}");
+    uint16_t threads = 0;
+    for (uint32_t i = 0; i < count; i++)
+        threads = max(threads, events[i].thread);
+    for (uint16_t t = 1; t <= threads; t++)
+        fprintf(f, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"thread %u\"}}",
+                t, t);
+
+    for (uint32_t i = 0; i < count; i++) {
+        const pager_event &e = events[i];
+        if (e.type < EVENT_FAULT || e.type > EVENT_SYSLOG)
+            continue;
+        fprintf(f, ",\n{\"name\":\"%s\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,", type_names[e.type],
+                e.thread, start_us(e));
+        if (e.type == EVENT_SWITCH)
+            fprintf(f, "\"ph\":\"i\",\"s\":\"t\",");
+        else
+            fprintf(f, "\"ph\":\"X\",\"dur\":%.3f,", duration_ns(e) / 1e3);
+        fprintf(f, "\"args\":{\"pid\":%u", e.pid);
+        switch (e.type) {
+        case EVENT_FAULT:
+            fprintf(f, ",\"vpn\":%u,\"kind\":\"%s\",\"write\":%s", e.arg,
+                    fault_kinds[(e.detail & ~EVENT_WRITE) % 4],
+                    e.detail & EVENT_WRITE ? "true" : "false");
+            break;
+        case EVENT_EVICT:
+            fprintf(f, ",\"vpn\":%u,\"path\":\"%s\"", e.arg, evict_paths[e.detail % 6]);
+            break;
+        case EVENT_DISK_READ:
+        case EVENT_DISK_WRITE:
+            fprintf(f, ",\"block\":%u,\"blocks\":%u", e.arg, e.detail);
+            break;
+        case EVENT_SYSLOG:
+            fprintf(f, ",\"len\":%u", e.arg);
+            break;
+        }
+        fprintf(f, "}}");
+    }
+    fprintf(f, "\n]}\n");
+    if (fclose(f) != 0) {
+        perror(path);
+        exit(1);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    const char *chrome = NULL;
+    unsigned int top = 10;
+
+    int c;
+    while ((c = getopt(argc, argv, "c:n:")) != -1) {
+        switch (c) {
+        case 'c':
+            chrome = optarg;
+            break;
+        case 'n':
+            top = strtoul(optarg, NULL, 0);
+            break;
+        default:
+            Usage();
+        }
+    }
+    if (optind != argc - 1)
+        Usage();
+
+    const char *path = argv[optind];
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        perror(path);
+        exit(1);
+    }
+    if ((size_t) st.st_size < sizeof(event_file_header)) {
+        fprintf(stderr, "%s: not an event file\n", path);
+        exit(1);
+    }
+    char *data = (char *) mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+        perror(path);
+        exit(1);
+    }
+    close(fd);
+
+    const event_file_header *h = (const event_file_header *) data;
+    if (strcmp(h->magic, EVENT_MAGIC) != 0 || h->version != EVENT_VERSION
+            || (st.st_size - sizeof(event_file_header)) / sizeof(pager_event) < h->count) {
+        fprintf(stderr, "%s: not a version %d event file\n", path, EVENT_VERSION);
+        exit(1);
+    }
+    const pager_event *events = (const pager_event *) (data + sizeof(event_file_header));
+    uint32_t count = h->count;
+
+    ns_per_tick = h->ticks1 > h->ticks0 ? (double) (h->ns1 - h->ns0) / (h->ticks1 - h->ticks0) : 1;
+    first_tick = count > 0 ? events[0].start : 0;
+    for (uint32_t i = 0; i < count; i++)
+        first_tick = min(first_tick, events[i].start);
+
+    latencies all_faults;
+    latencies faults[4];
+    latencies evictions[6];
+    latencies disk_reads, disk_writes, syslogs;
+    unsigned long long read_blocks = 0, write_blocks = 0, switches = 0;
+    map<uint32_t, latencies> by_process;
+    uint64_t last_tick = first_tick;
+
+    for (uint32_t i = 0; i < count; i++) {
+        const pager_event &e = events[i];
+        double t = duration_ns(e);
+        last_tick = max(last_tick, e.start + e.ticks);
+        switch (e.type) {
+        case EVENT_FAULT:
+            all_faults.add(t);
+            faults[(e.detail & ~EVENT_WRITE) % 4].add(t);
+            by_process[e.pid].add(t);
+            break;
+        case EVENT_EVICT:
+            evictions[e.detail % 6].add(t);
+            break;
+        case EVENT_DISK_READ:
+            disk_reads.add(t);
+            read_blocks += e.detail;
+            break;
+        case EVENT_DISK_WRITE:
+            disk_writes.add(t);
+            write_blocks += e.detail;
+            break;
+        case EVENT_SWITCH:
+            switches++;
+            break;
+        case EVENT_SYSLOG:
+            syslogs.add(t);
+            break;
+        }
+    }
+
+    printf("events %u\tlost %llu\tspan_ms %.3f\tns_per_tick %.4f\tswitches %llu\n", count,
+           (unsigned long long) h->lost, (last_tick - first_tick) * ns_per_tick / 1e6,
+           ns_per_tick, switches);
+
+    print_heading("fault");
+    all_faults.print("all");
+    for (int k = 0; k < 4; k++)
+        faults[k].print(fault_kinds[k]);
+    print_heading("evict");
+    for (int k = 0; k < 6; k++)
+        evictions[k].print(evict_paths[k]);
+    print_heading("request");
+    disk_reads.print("disk_read");
+    disk_writes.print("disk_write");
+    syslogs.print("syslog");
+    if (!disk_reads.ns.empty() || !disk_writes.ns.empty())
+        printf("blocks read %llu written %llu\n", read_blocks, write_blocks);
+
+    // the processes with the slowest faults first
+    vector<pair<double, uint32_t> > slowest;
+    for (map<uint32_t, latencies>::iterator p = by_process.begin(); p != by_process.end(); ++p) {
+        sort(p->second.ns.begin(), p->second.ns.end());
+        slowest.push_back(make_pair(p->second.percentile(0.99), p->first));
+    }
+    sort(slowest.rbegin(), slowest.rend());
+    print_heading("process");
+    for (size_t i = 0; i < slowest.size() && i < top; i++) {
+        char name[32];
+        snprintf(name, sizeof(name), "pid %u", slowest[i].second);
+        by_process[slowest[i].second].print(name);
+    }
+
+    print_histogram(all_faults.ns);
+
+    if (chrome != NULL)
+        write_chrome(chrome, events, count);
+    return 0;
+}
@@ -0,0 +1,95 @@
+/*
+ * free_set.h
+ *
+ * Free physical pages of the pager.  Items that have never been handed out
+ * are an implicit range [next, size), so init is constant time whatever the
+ * size.  Items given back are recorded in a bitmap that grows only as far as
+ * the highest one returned, with a summary bitmap of its non-empty words;
+ * take() prefers them to the untouched range, lowest first, found with
+ * count-trailing-zeros on the summary and then on the word.
+ */
+
+#ifndef _FREE_SET_H_
+#define _FREE_SET_H_
+
+#include <cassert>
+#include <stdint.h>
+#include <vector>
+
+class free_set {
+public:
+    void init(unsigned int n)
+    {
+        size = n;
+        next = 0;
+        returned = 0;
+        low = 0;
+        words.clear();
+        summary.clear();
+    }
+
+    bool empty() const
+    {
+        return returned == 0 && next == size;
+    }
+
+    unsigned int count() const
+    {
+        return returned + (size - next);
+    }
+
+    bool contains(unsigned int i) const
+    {
+        if (i >= next)
+            return i < size;
+        return i / 64 < words.size() && (words[i / 64] & bit(i)) != 0;
+    }
+
+    unsigned int take()
+    {
+        assert(!empty());
+        if (returned == 0)
+            return next++;
+
+        // the first non-empty word; low is never past it
+        while (summary[low] == 0)
+            low++;
+        unsigned int w = low * 64 + __builtin_ctzll(summary[low]);
+        unsigned int i = w * 64 + __builtin_ctzll(words[w]);
+        words[w] &= words[w] - 1;
+        if (words[w] == 0)
+            summary[low] &= ~bit(w);
+        returned--;
+        return i;
+    }
+
+    void release(unsigned int i)
+    {
+        assert(i < next && !contains(i));
+        unsigned int w = i / 64;
+        if (w >= words.size()) {
+            words.resize(w + 1, 0);
+            summary.resize(w / 64 + 1, 0);
+        }
+        words[w] |= bit(i);
+        summary[w / 64] |= bit(w);
+        if (w / 64 < low)
+            low = w / 64;
+        returned++;
+    }
+
+private:
+    static uint64_t bit(unsigned int i)
+    {
+        return (uint64_t) 1 << (i % 64);
+    }
+
+    unsigned int size;
+    unsigned int next;                  // items from next up have never been taken
+    unsigned int returned;              // items set in words
+    unsigned int low;                   // no summary word below low is non-empty
+    std::vector<uint64_t> words;        // bit i: item i was returned
+    std::vector<uint64_t> summary;      // bit w: words[w] is non-empty
+};
+
+#endif /* _FREE_SET_H_ */
@@ -0,0 +1,222 @@
+/*
+ * libpager.cc
+ *
+ * App side of the in-process simulator.  Each app process runs on its own
+ * stack (a ucontext) inside the simulator, and the routines of vm_app.h call
+ * straight into the pager.  The scheduler is non-preemptive like the real
+ * infrastructure's: a process runs until it calls vm_yield() or exits.
+ *
+ * All calls into the pager go through the trace_vm_* wrappers, so a run can
+ * be recorded for replay.
+ */
+
+#include <cassert>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <iostream>
+#include <sys/mman.h>
+#include <ucontext.h>
+#include "vm_pager.h"
+#include "vm_app.h"
+#include "vm_sim.h"
+#include "trace.h"
+
+using namespace std;
+
+#define APP_STACK_SIZE (1 << 20)
+
+struct app_process {
+    pid_t pid;
+    ucontext_t context;
+    char *stack;
+    unsigned int arena_pages;   // number of valid pages in the arena
+    int status;
+    bool killed;                // the pager refused one of its accesses
+    bool done;
+};
+
+static deque<app_process *> ready_queue;
+static app_process *running;
+static ucontext_t scheduler_context;
+static pid_t switched_pid = -1;     // process the pager last switched to
+
+/*
+ * Tear down the running process and return to the scheduler.  Never returns.
+ */
+static void app_exit(int status)
+{
+    trace_vm_destroy();
+    mmu_flush();
+    switched_pid = -1;
+
+    running->status = status;
+    running->done = true;
+    setcontext(&scheduler_context);
+    abort();
+}
+
+static void app_start()
+{
+    app_exit(vm_app_main());
+}
+
+/*
+ * Arena accesses the page table does not allow end up here.  Ask the pager to
+ * handle the fault and retry the access, or kill the process if the pager
+ * refuses it.
+ */
+static void handle_fault(int sig, siginfo_t *info, void *context)
+{
+    ucontext_t *uc = (ucontext_t *) context;
+    void *addr = info->si_addr;
+    unsigned long long offset = (unsigned long long) addr - (unsigned long long) VM_ARENA_BASEADDR;
+
+    if (running == NULL || offset >= VM_ARENA_SIZE) {
+        // not an arena access: let the default action dump core
+        signal(sig, SIG_DFL);
+        return;
+    }
+
+    // bit 1 of the x86 page fault error code is set for writes
+    bool write_flag = (uc->uc_mcontext.gregs[REG_ERR] & 2) != 0;
+
+    mmu_faults++;
+    if (trace_vm_fault(addr, write_flag)) {
+        cerr << "process " << running->pid << ": segmentation fault at " << addr << endl;
+        running->killed = true;
+        app_exit(-1);
+    }
+    mmu_sync(running->arena_pages);
+}
+
+void *vm_app_extend()
+{
+    void *addr = trace_vm_extend();
+    if (addr != NULL) {
+        unsigned int page = ((unsigned long long) addr - (unsigned long long) VM_ARENA_BASEADDR) / VM_PAGESIZE;
+        if (page + 1 > running->arena_pages)
+            running->arena_pages = page + 1;
+    }
+    mmu_sync(running->arena_pages);
+    return addr;
+}
+
+void *vm_app_extend_n(unsigned int count)
+{
+    void *addr = trace_vm_extend_n(count);
+    if (addr != NULL) {
+        unsigned int page = ((unsigned long long) addr - (unsigned long long) VM_ARENA_BASEADDR) / VM_PAGESIZE;
+        if (page + count > running->arena_pages)
+            running->arena_pages = page + count;
+    }
+    mmu_sync(running->arena_pages);
+    return addr;
+}
+
+int vm_app_release(void *addr, unsigned int len)
+{
+    int result = trace_vm_release(addr, len);
+    mmu_sync(running->arena_pages);
+    return result;
+}
+
+int vm_app_advise(void *addr, unsigned int len, int hint)
+{
+    int result = trace_vm_advise(addr, len, hint);
+    mmu_sync(running->arena_pages);
+    return result;
+}
+
+void *vm_app_shm_attach(const char *name, unsigned int pages)
+{
+    void *addr = trace_vm_shm_attach(name, pages);
+    if (addr != NULL) {
+        unsigned int page = ((unsigned long long) addr - (unsigned long long) VM_ARENA_BASEADDR) / VM_PAGESIZE;
+        if (page + pages > running->arena_pages)
+            running->arena_pages = page + pages;
+    }
+    mmu_sync(running->arena_pages);
+    return addr;
+}
+
+int vm_app_shm_unlink(const char *name)
+{
+    int result = trace_vm_shm_unlink(name);
+    mmu_sync(running->arena_pages);
+    return result;
+}
+
+int vm_app_syslog(void *message, unsigned int len)
+{
+    int result = trace_vm_syslog(message, len);
+    mmu_sync(running->arena_pages);
+    return result;
+}
+
+void vm_yield()
+{
+    swapcontext(&running->context, &scheduler_context);
+}
+
+int vm_app_run(unsigned int copies)
+{
+    struct sigaction sa;
+    sa.sa_sigaction = handle_fault;
+    sigemptyset(&sa.sa_mask);
+    // app_exit leaves the handler through setcontext, so never block SIGSEGV
+    sa.sa_flags = SA_SIGINFO | SA_NODEFER;
+    if (sigaction(SIGSEGV, &sa, NULL) < 0) {
+        perror("sigaction");
+        exit(1);
+    }
+
+    mmu_attach();
+
+    for (unsigned int i = 0; i < copies; i++) {
+        app_process *p = new app_process;
+        p->pid = 1000 + i;
+        p->arena_pages = 0;
+        p->status = 0;
+        p->killed = false;
+        p->done = false;
+        p->stack = (char *) mmap(NULL, APP_STACK_SIZE, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        assert(p->stack != MAP_FAILED);
+
+        getcontext(&p->context);
+        p->context.uc_stack.ss_sp = p->stack;
+        p->context.uc_stack.ss_size = APP_STACK_SIZE;
+        p->context.uc_link = NULL;
+        makecontext(&p->context, app_start, 0);
+
+        trace_vm_create(p->pid);
+        ready_queue.push_back(p);
+    }
+
+    int failed = 0;
+    while (!ready_queue.empty()) {
+        running = ready_queue.front();
+        ready_queue.pop_front();
+
+        if (switched_pid != running->pid) {
+            trace_vm_switch(running->pid);
+            mmu_flush();
+            mmu_sync(running->arena_pages);
+            switched_pid = running->pid;
+        }
+        swapcontext(&scheduler_context, &running->context);
+
+        if (running->done) {
+            if (!running->killed && running->status != 0)
+                failed++;
+            munmap(running->stack, APP_STACK_SIZE);
+            delete running;
+        } else {
+            ready_queue.push_back(running);
+        }
+        running = NULL;
+    }
+    return failed;
+}
@@ -0,0 +1,206 @@
+/*
+ * lz_page.h
+ *
+ * LZ77 compression of single pages for the pager's compressed swap cache.
+ * The format is that of LZ4 blocks: sequences of a token (literal length
+ * in the high nibble, match length - 4 in the low one, 15 meaning more
+ * length bytes follow, each adding up to 255), the literals, and a 16-bit
+ * little-endian match offset.  The last sequence has literals only.
+ * Matches are found through a hash table of 4-byte sequences, skipping
+ * ahead faster the longer no match is found, so pages that do not
+ * compress are given up on quickly.
+ */
+
+#ifndef _LZ_PAGE_H_
+#define _LZ_PAGE_H_
+
+#include <stdint.h>
+#include <cstring>
+#include "vm_pager.h"
+
+#define LZ_HASH_BITS    12
+#define LZ_MIN_MATCH    4
+// the last bytes of a page are always literals, so that matches can be
+// extended without bounds checks on every byte
+#define LZ_LAST_LITERALS 8
+// unit of the copies of short runs
+#define LZ_COPY         16
+
+inline uint32_t lz_load32(const uint8_t* p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+// write a length beyond the 15 of its token nibble
+inline uint8_t* lz_put_length(uint8_t* op, unsigned int len)
+{
+    for (; len >= 255; len -= 255)
+        *op++ = 255;
+    *op++ = (uint8_t) len;
+    return op;
+}
+
+/*
+ * Compress the page at "page" into "out", which has room for "cap" bytes.
+ * Returns the compressed length, or 0 if it would exceed cap.
+ */
+inline unsigned int lz_compress(const void* page, void* out, unsigned int cap)
+{
+    const uint8_t* src = (const uint8_t*) page;
+    uint8_t* op = (uint8_t*) out;
+    uint8_t* const end = op + cap;
+    uint16_t table[1 << LZ_HASH_BITS];
+    memset(table, 0, sizeof(table));
+
+    unsigned int anchor = 0;
+    unsigned int i = 1;
+    unsigned int misses = 0;
+    const unsigned int limit = VM_PAGESIZE - LZ_LAST_LITERALS;
+    while (i < limit) {
+        uint32_t seq = lz_load32(src + i);
+        uint32_t h = (seq * 2654435761U) >> (32 - LZ_HASH_BITS);
+        unsigned int ref = table[h];
+        table[h] = (uint16_t) i;
+        if (lz_load32(src + ref) != seq || ref >= i) {
+            i += 1 + (misses++ >> 5);
+            continue;
+        }
+        misses = 0;
+
+        // back over literals that are part of the match
+        while (i > anchor && ref > 0 && src[i - 1] == src[ref - 1]) {
+            i--;
+            ref--;
+        }
+        // extend the match 8 bytes at a time; the lowest differing bit of
+        // the first words that differ gives its last byte
+        unsigned int len = LZ_MIN_MATCH;
+        bool differ = false;
+        while (i + len + 8 <= limit) {
+            uint64_t a, b;
+            memcpy(&a, src + ref + len, sizeof(a));
+            memcpy(&b, src + i + len, sizeof(b));
+            if (a != b) {
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+                len += __builtin_clzll(a ^ b) / 8;
+#else
+                len += __builtin_ctzll(a ^ b) / 8;
+#endif
+                differ = true;
+                break;
+            }
+            len += 8;
+        }
+        while (!differ && i + len < limit && src[ref + len] == src[i + len])
+            len++;
+
+        unsigned int literals = i - anchor;
+        // token, literal and match length bytes, literals, offset
+        if (op + 1 + literals / 255 + 1 + literals + 2 + len / 255 + 1 > end)
+            return 0;
+        uint8_t* token = op++;
+        *token = (uint8_t) ((literals >= 15 ? 15 : literals) << 4);
+        if (literals >= 15)
+            op = lz_put_length(op, literals - 15);
+        if (literals <= LZ_COPY && end - op >= LZ_COPY && anchor + LZ_COPY <= VM_PAGESIZE)
+            memcpy(op, src + anchor, LZ_COPY);
+        else
+            memcpy(op, src + anchor, literals);
+        op += literals;
+        uint16_t offset = (uint16_t) (i - ref);
+        *op++ = (uint8_t) offset;
+        *op++ = (uint8_t) (offset >> 8);
+        unsigned int extra = len - LZ_MIN_MATCH;
+        *token |= (uint8_t) (extra >= 15 ? 15 : extra);
+        if (extra >= 15)
+            op = lz_put_length(op, extra - 15);
+
+        i += len;
+        anchor = i;
+        // the end of the match is where the next one most likely starts
+        if (i - 2 < limit)
+            table[(lz_load32(src + i - 2) * 2654435761U) >> (32 - LZ_HASH_BITS)] = (uint16_t) (i - 2);
+    }
+
+    unsigned int literals = VM_PAGESIZE - anchor;
+    if (op + 1 + literals / 255 + 1 + literals > end)
+        return 0;
+    *op++ = (uint8_t) ((literals >= 15 ? 15 : literals) << 4);
+    if (literals >= 15)
+        op = lz_put_length(op, literals - 15);
+    memcpy(op, src + anchor, literals);
+    op += literals;
+    return op - (uint8_t*) out;
+}
+
+/*
+ * Decompress "length" bytes at "in", made by lz_compress, into the page at
+ * "page".  Returns false if they do not make exactly one page.
+ */
+inline bool lz_decompress(const void* in, unsigned int length, void* page)
+{
+    const uint8_t* ip = (const uint8_t*) in;
+    const uint8_t* const end = ip + length;
+    uint8_t* dst = (uint8_t*) page;
+    unsigned int o = 0;
+    while (ip < end) {
+        uint8_t token = *ip++;
+        unsigned int literals = token >> 4;
+        if (literals == 15) {
+            uint8_t b;
+            do {
+                if (ip == end)
+                    return false;
+                b = *ip++;
+                literals += b;
+            } while (b == 255);
+        }
+        if (literals > (unsigned int) (end - ip) || literals > VM_PAGESIZE - o)
+            return false;
+        // short runs are copied 16 bytes at a time where both sides have
+        // room for it, the bytes beyond them overwritten later
+        if (literals <= LZ_COPY && end - ip >= LZ_COPY && VM_PAGESIZE - o >= LZ_COPY)
+            memcpy(dst + o, ip, LZ_COPY);
+        else
+            memcpy(dst + o, ip, literals);
+        ip += literals;
+        o += literals;
+        if (ip == end)
+            break;
+
+        if (end - ip < 2)
+            return false;
+        unsigned int offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        unsigned int len = (token & 15) + LZ_MIN_MATCH;
+        if ((token & 15) == 15) {
+            uint8_t b;
+            do {
+                if (ip == end)
+                    return false;
+                b = *ip++;
+                len += b;
+            } while (b == 255);
+        }
+        if (offset == 0 || offset > o || len > VM_PAGESIZE - o)
+            return false;
+        if (offset >= LZ_COPY && (len + LZ_COPY - 1) / LZ_COPY * LZ_COPY <= VM_PAGESIZE - o) {
+            for (unsigned int done = 0; done < len; done += LZ_COPY)
+                memcpy(dst + o + done, dst + o - offset + done, LZ_COPY);
+        } else {
+            // a match overlapping its own output repeats its first "offset"
+            // bytes: copy them in runs that double, never overlapping
+            for (unsigned int done = 0; done < len; ) {
+                unsigned int n = len - done < done + offset ? len - done : done + offset;
+                memcpy(dst + o + done, dst + o - offset, n);
+                done += n;
+            }
+        }
+        o += len;
+    }
+    return o == VM_PAGESIZE;
+}
+
+#endif /* _LZ_PAGE_H_ */
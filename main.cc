@@ -0,0 +1,110 @@
+/*
+ * main.cc
+ *
+ * Driver for the in-process simulator: sets up physical memory, the disk and
+ * the pager, then runs the app linked into this binary.
+ */
+
+#include <cstdlib>
+#include <iostream>
+#include <unistd.h>
+#include "vm_pager.h"
+#include "vm_sim.h"
+#include "pager.h"
+#include "trace.h"
+
+using namespace std;
+
+#define MAX_MEMORY_PAGES (1U << 30)     // ppage is a 30-bit field
+
+static void Usage()
+{
+    cerr << "Usage: pager [-m memory_pages] [-d disk_blocks] [-n processes] [-p policy] [-w clean_low] [-k dedup_pages] [-z zcache_frames] [-o overcommit] [-s stats_format] [-e events_file] [-t trace_file] [-q]" << endl;
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    unsigned long memory_pages = 4;
+    unsigned long disk_blocks = 1024;
+    unsigned long processes = 1;
+    const char *trace_path = NULL;
+    bool quiet = false;
+
+    int c;
+    while ((c = getopt(argc, argv, "m:d:n:p:w:k:z:o:s:e:t:q")) != -1) {
+        switch (c) {
+        case 'm':
+            memory_pages = strtoul(optarg, NULL, 0);
+            break;
+        case 'd':
+            disk_blocks = strtoul(optarg, NULL, 0);
+            break;
+        case 'p':
+            pager_policy = optarg;
+            break;
+        case 'w':
+            pager_clean_low = strtoul(optarg, NULL, 0);
+            break;
+        case 'k':
+            pager_dedup_pages = strtoul(optarg, NULL, 0);
+            break;
+        case 'z':
+            pager_zcache_frames = strtoul(optarg, NULL, 0);
+            break;
+        case 'o':
+            pager_overcommit = optarg;
+            break;
+        case 's':
+            pager_stats_format = optarg;
+            break;
+        case 'e':
+            pager_events = optarg;
+            break;
+        case 'n':
+            processes = strtoul(optarg, NULL, 0);
+            break;
+        case 't':
+            trace_path = optarg;
+            break;
+        case 'q':
+            quiet = true;
+            break;
+        default:
+            Usage();
+        }
+    }
+    if (optind != argc || disk_blocks == 0 || processes == 0)
+        Usage();
+    if (memory_pages < 2) {
+        cerr << "error: too few physical memory pages" << endl;
+        exit(1);
+    }
+    if (memory_pages > MAX_MEMORY_PAGES) {
+        cerr << "error: too many physical memory pages" << endl;
+        exit(1);
+    }
+
+    pm_init(memory_pages);
+    disk_init(disk_blocks);
+    vm_init(memory_pages, disk_blocks);
+    if (trace_path)
+        trace_open(trace_path, memory_pages, disk_blocks);
+
+    if (quiet) {
+        // syslog output and app output on cout are discarded
+        cout.setstate(ios::badbit);
+    } else {
+        cout << "Pager started with " << memory_pages << " physical memory pages" << endl;
+    }
+
+    int failed = vm_app_run(processes);
+    pager_shutdown();
+    trace_close();
+
+    if (!quiet) {
+        cout << "disk_read " << disk_reads << "\tdisk_write " << disk_writes
+             << "\tfaults " << mmu_faults << endl;
+    }
+    return failed ? 1 : 0;
+}
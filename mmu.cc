@@ -0,0 +1,232 @@
+/*
+ * mmu.cc
+ *
+ * MMU for the in-process simulator.
+ *
+ * mmu_translate is a software MMU for drivers that do not run app code
+ * (benchmarks, trace replay): every access checks the page table entry and
+ * raises vm_fault when the access is not allowed.  mmu_read and mmu_write
+ * copy through it with the physical page pinned in a per-thread TLB slot,
+ * which pm_shootdown waits for.
+ *
+ * Apps dereference arena pointers directly, so for them the arena is also
+ * reserved in the host address space and each arena page is mapped onto its
+ * physical page (through the memory file behind pm_physmem) with exactly
+ * the permissions the page table grants.  Accesses the page table does not
+ * allow trap, and the trap handler in libpager.cc calls vm_fault.
+ */
+
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sched.h>
+#include <sys/mman.h>
+#include "vm_pager.h"
+#include "vm_sim.h"
+
+#define ARENA_PAGES (VM_ARENA_SIZE / VM_PAGESIZE)
+
+unsigned long long mmu_faults;
+
+void *mmu_translate(void *addr, bool write_flag)
+{
+    unsigned long long offset = (unsigned long long) addr - (unsigned long long) VM_ARENA_BASEADDR;
+    if (offset >= VM_ARENA_SIZE || page_table_base_register == NULL)
+        return NULL;
+
+    // with several threads in the pager, another one may revoke the access
+    // again before this one retries it
+    page_table_entry_t *pte = &page_table_base_register->ptes[offset / VM_PAGESIZE];
+    while (!(write_flag ? pte->write_enable : pte->read_enable)) {
+        __atomic_add_fetch(&mmu_faults, 1, __ATOMIC_RELAXED);
+        if (vm_fault(addr, write_flag))
+            return NULL;
+        pte = &page_table_base_register->ptes[offset / VM_PAGESIZE];
+    }
+    return (char *) pm_physmem + (size_t) pte->ppage * VM_PAGESIZE + offset % VM_PAGESIZE;
+}
+
+/*
+ * TLB slots of the threads copying through mmu_read and mmu_write: the
+ * physical page a thread is copying, plus one, or 0.  A thread takes a
+ * slot on its first copy and gives it back when it exits.
+ */
+#define TLB_SLOTS 64
+
+struct alignas(64) tlb_slot {
+    unsigned int pinned;
+    bool taken;
+};
+
+static tlb_slot tlb_slots[TLB_SLOTS];
+
+struct tlb_owner {
+    tlb_slot *slot;
+
+    tlb_owner() : slot(NULL)
+    {
+        for (unsigned int i = 0; i < TLB_SLOTS && slot == NULL; i++) {
+            bool free = false;
+            if (__atomic_compare_exchange_n(&tlb_slots[i].taken, &free, true, false,
+                    __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+                slot = &tlb_slots[i];
+        }
+        if (slot == NULL) {
+            fprintf(stderr, "mmu: more than %d threads copying at once\n", TLB_SLOTS);
+            exit(1);
+        }
+    }
+
+    ~tlb_owner()
+    {
+        __atomic_store_n(&slot->taken, false, __ATOMIC_RELEASE);
+    }
+};
+
+static thread_local tlb_owner tlb;
+
+void pm_shootdown(unsigned int ppage)
+{
+    // the page table entries were changed before this fence, and a copy
+    // pins its page before it checks the entry again, so a copy that the
+    // loop below misses sees the change and does not touch the page
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    for (unsigned int i = 0; i < TLB_SLOTS; i++) {
+        while (__atomic_load_n(&tlb_slots[i].pinned, __ATOMIC_ACQUIRE) == ppage + 1)
+            sched_yield();
+    }
+}
+
+// pin the physical page "addr" maps in the thread's TLB slot, once the page
+// table entry still allows the access with the page pinned.  Returns the
+// address of the byte in pm_physmem, or NULL as mmu_translate.
+static char *pin(void *addr, bool write_flag)
+{
+    unsigned long long offset = (unsigned long long) addr - (unsigned long long) VM_ARENA_BASEADDR;
+    for (;;) {
+        char *p = (char *) mmu_translate(addr, write_flag);
+        if (p == NULL)
+            return NULL;
+        unsigned int ppage = (p - (char *) pm_physmem) / VM_PAGESIZE;
+        __atomic_store_n(&tlb.slot->pinned, ppage + 1, __ATOMIC_SEQ_CST);
+        page_table_entry_t pte;
+        __atomic_load(&page_table_base_register->ptes[offset / VM_PAGESIZE], &pte, __ATOMIC_SEQ_CST);
+        if ((write_flag ? pte.write_enable : pte.read_enable) && pte.ppage == ppage)
+            return p;
+        __atomic_store_n(&tlb.slot->pinned, 0, __ATOMIC_RELEASE);
+    }
+}
+
+static int copy(char *addr, char *buf, size_t len, bool write_flag)
+{
+    while (len > 0) {
+        size_t n = VM_PAGESIZE - ((unsigned long long) addr % VM_PAGESIZE);
+        if (n > len)
+            n = len;
+        char *p = pin(addr, write_flag);
+        if (p == NULL)
+            return -1;
+        if (write_flag)
+            memcpy(p, buf, n);
+        else
+            memcpy(buf, p, n);
+        __atomic_store_n(&tlb.slot->pinned, 0, __ATOMIC_RELEASE);
+        addr += n;
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+int mmu_read(const void *addr, void *buf, size_t len)
+{
+    return copy((char *) addr, (char *) buf, len, false);
+}
+
+int mmu_write(void *addr, const void *buf, size_t len)
+{
+    return copy((char *) addr, (char *) buf, len, true);
+}
+
+/*
+ * Host view of the arena: the physical page each arena page is mapped onto
+ * and the protection it is currently mapped with.
+ */
+struct host_pte {
+    unsigned int ppage;
+    bool mapped;
+    int prot;
+};
+
+static host_pte host_ptes[ARENA_PAGES];
+static unsigned int host_pages;         // host_ptes[host_pages..] are unmapped
+
+void mmu_attach()
+{
+    void *arena = mmap(VM_ARENA_BASEADDR, VM_ARENA_SIZE, PROT_NONE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED_NOREPLACE, -1, 0);
+    if (arena != VM_ARENA_BASEADDR) {
+        perror("mmu_attach: cannot reserve arena");
+        exit(1);
+    }
+    host_pages = 0;
+}
+
+void mmu_sync(unsigned int npages)
+{
+    assert(npages <= ARENA_PAGES);
+
+    for (unsigned int i = 0; i < npages; i++) {
+        page_table_entry_t pte = page_table_base_register->ptes[i];
+        host_pte *h = &host_ptes[i];
+
+        // x86 cannot map a page write-only, so write_enable implies read
+        int prot = PROT_NONE;
+        if (pte.write_enable)
+            prot = PROT_READ | PROT_WRITE;
+        else if (pte.read_enable)
+            prot = PROT_READ;
+
+        if (prot == PROT_NONE && (!h->mapped || h->prot == PROT_NONE))
+            continue;
+        if (h->mapped && h->ppage == pte.ppage && h->prot == prot)
+            continue;
+
+        char *vaddr = (char *) VM_ARENA_BASEADDR + (size_t) i * VM_PAGESIZE;
+        if (prot == PROT_NONE || (h->mapped && h->ppage == pte.ppage)) {
+            if (mprotect(vaddr, VM_PAGESIZE, prot) < 0) {
+                perror("mmu_sync: mprotect");
+                exit(1);
+            }
+        } else {
+            if (mmap(vaddr, VM_PAGESIZE, prot, MAP_SHARED | MAP_FIXED, pm_fd,
+                    (off_t) pte.ppage * VM_PAGESIZE) != vaddr) {
+                perror("mmu_sync: mmap");
+                exit(1);
+            }
+            h->mapped = true;
+            h->ppage = pte.ppage;
+        }
+        h->prot = prot;
+    }
+    if (npages > host_pages)
+        host_pages = npages;
+}
+
+void mmu_flush()
+{
+    if (host_pages == 0)
+        return;
+
+    if (mmap(VM_ARENA_BASEADDR, (size_t) host_pages * VM_PAGESIZE, PROT_NONE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1, 0) != VM_ARENA_BASEADDR) {
+        perror("mmu_flush: mmap");
+        exit(1);
+    }
+    for (unsigned int i = 0; i < host_pages; i++) {
+        host_ptes[i].mapped = false;
+        host_ptes[i].prot = PROT_NONE;
+    }
+    host_pages = 0;
+}
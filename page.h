@@ -0,0 +1,221 @@
+/*
+ * page.h
+ *
+ * The pager's bookkeeping for virtual and physical pages, shared by pager.cc
+ * and the page replacement engines (replace.h).
+ */
+
+#ifndef _PAGE_H_
+#define _PAGE_H_
+
+#include <climits>
+#include <pthread.h>
+#include <sys/types.h>
+#include <vector>
+#include "vm_pager.h"
+#include "pager.h"
+
+/*
+ * Per virtual page state, 8 bytes.  The physical page and the access bits
+ * are kept in the page table entry with the same index, not duplicated here.
+ * readahead is set while a page read ahead of the faults has not been
+ * accessed yet.  busy is set while the page's frame is being written back
+ * or evicted with its shard's lock dropped; the page must not be touched
+ * until it clears.  shm is set on the pages of a window onto a shared
+ * segment (see vm_shm_attach): their state is that of the segment's page,
+ * and whether the window maps the page's frame is told by the frame's
+ * mappings, so only the window's own process writes the vpage.  zcached
+ * is set on a page evicted into the compressed swap cache, which holds its
+ * only copy: it has no disk block meanwhile.  advice is the access pattern
+ * the process gave for the page with vm_advise (VM_ADVISE_NORMAL,
+ * _SEQUENTIAL or _RANDOM).
+ */
+struct vpage {
+    unsigned int disk_block;
+    unsigned int written_to : 1;
+    unsigned int dirty : 1;
+    unsigned int resident : 1;
+    unsigned int reference : 1;
+    unsigned int valid : 1;
+    unsigned int readahead : 1;
+    unsigned int busy : 1;
+    unsigned int shm : 1;
+    unsigned int zcached : 1;
+    unsigned int advice : 2;
+};
+
+/* disk_block of a page that has never been written back */
+#define NO_BLOCK (~0U)
+
+/* swap_base of a process none of whose pages has a disk block yet */
+#define NO_SWAP_BASE LLONG_MIN
+
+/* pages first_vpn.. of a process mapping the pages of a shared segment */
+struct shm_window {
+    unsigned int first_vpn;
+    unsigned int pages;
+    struct shm_segment* seg;
+};
+
+struct process_info {
+    page_table_t* ptbl_ptr;
+    std::vector<vpage> pages;   // indexed by virtual page number, up to top_valid_index
+    int top_valid_index;
+    pid_t pid;
+
+    // read-ahead: the last page read from disk, the stride between the last
+    // two such pages, and the number of pages to read ahead of a stream
+    unsigned int ra_last;
+    int ra_stride;
+    unsigned int ra_window;
+
+    // disk block of virtual page 0 if the process's pages were laid out on
+    // disk in arena order; new blocks are placed there when free
+    long long swap_base;
+
+    // resident set: the frames charged to the process, the number of them
+    // it is guaranteed (rss_min) and its hard limit (rss_max, 0 for none).
+    // rss_hand is a clock hand over its pages, for evicting its own pages
+    // at the limit.
+    unsigned int rss;
+    unsigned int rss_min;
+    unsigned int rss_max;
+    unsigned int rss_hand;
+
+    // serialises the pager calls made as this process when several threads
+    // call into the pager
+    pthread_mutex_t lock;
+
+    // the shard of physical memory the process takes its frames from (see
+    // pager_shard in pager.cc), whose lock guards its pages
+    unsigned int shard;
+
+    // segment is set if the process holds the pages of a shared segment
+    // rather than running.  windows are the segments a process has attached.
+    bool segment;
+    std::vector<shm_window> windows;
+
+    // the process's slot in the state file (see state_file.h), or NO_SLOT
+    unsigned int state_slot;
+
+    pager_stats stats;
+};
+
+/* the pager takes locks: several threads may be in it (see pager_threads) */
+extern bool pager_locking;
+
+/*
+ * count n events in counter c of the totals, which threads holding the
+ * locks of different shards update at once
+ */
+inline void count_total(unsigned long long pager_stats::*c, unsigned long long n = 1)
+{
+    if (pager_locking)
+        __atomic_add_fetch(&(pager_totals.*c), n, __ATOMIC_RELAXED);
+    else
+        pager_totals.*c += n;
+}
+
+/* count n events in counter c of proc and of the totals */
+inline void count_event(process_info* proc, unsigned long long pager_stats::*c,
+        unsigned long long n = 1)
+{
+    proc->stats.*c += n;
+    count_total(c, n);
+}
+
+/*
+ * Identifies a virtual page across processes, e.g. for the history a
+ * replacement engine keeps about pages that are no longer resident.
+ */
+typedef unsigned long long page_key;
+
+inline page_key make_page_key(pid_t pid, unsigned int vpn)
+{
+    return ((page_key) (unsigned int) pid << 32) | vpn;
+}
+
+/* a virtual page of a process */
+struct mapping {
+    process_info* proc;
+    unsigned int vpn;
+
+    vpage& page() const
+    {
+        return proc->pages[vpn];
+    }
+
+    page_table_entry_t& pte() const
+    {
+        return proc->ptbl_ptr->ptes[vpn];
+    }
+};
+
+/*
+ * Core map: one entry per physical page, mapping the frame back to the
+ * process and virtual page number resident in it.  proc is NULL for a free
+ * frame.  A frame shared copy-on-write by several pages (after vm_fork)
+ * lists the pages besides proc and vpn in "more", else more is NULL.  proc
+ * and vpn are the primary mapping: the replacement engine and write-back go
+ * by its page, and the frame is charged to its process.  All the pages of
+ * a frame shared copy-on-write have the same state and are mapped
+ * read-only.  The frame of a shared segment's page has the segment as its
+ * primary mapping, and the windows mapping it in "more".
+ */
+struct frame : mapping {
+    std::vector<mapping>* more;
+
+    page_key key() const
+    {
+        return make_page_key(proc->pid, vpn);
+    }
+};
+
+extern frame* core_map;
+
+/* address of frame f in physical memory (in size_t, as frames past 4 GiB
+ * would wrap in unsigned arithmetic) */
+inline char* frame_addr(unsigned int f)
+{
+    return (char *) pm_physmem + (size_t) f * VM_PAGESIZE;
+}
+
+/* frame f is shared copy-on-write, so a write to it needs a copy */
+inline bool cow_shared(unsigned int f)
+{
+    return core_map[f].more != NULL && !core_map[f].proc->segment;
+}
+
+/* the page has to be written to disk when it is evicted */
+inline bool needs_writeback(const vpage& p)
+{
+    return p.dirty && p.written_to;
+}
+
+/* revoke access to the page in frame f, through every page sharing the frame */
+inline void revoke_frame(unsigned int f)
+{
+    frame& fr = core_map[f];
+    fr.pte().read_enable = 0;
+    fr.pte().write_enable = 0;
+    if (fr.more != NULL) {
+        for (size_t i = 0; i < fr.more->size(); i++) {
+            (*fr.more)[i].pte().read_enable = 0;
+            (*fr.more)[i].pte().write_enable = 0;
+        }
+    }
+}
+
+/*
+ * Clear the reference bit of the page in frame f and revoke access to it,
+ * so that the next access faults and vm_fault sets the reference bit again.
+ */
+inline void clear_reference(unsigned int f)
+{
+    frame& fr = core_map[f];
+    count_event(fr.proc, &pager_stats::revocations);
+    fr.page().reference = false;
+    revoke_frame(f);
+}
+
+#endif /* _PAGE_H_ */
@@ -0,0 +1,91 @@
+/*
+ * page_hash.h
+ *
+ * Page checksum used by the dedup scanner to find pages with the same
+ * contents.  The page is hashed in 16 independent 32-bit lanes (rounds of
+ * xxHash32), which are then folded into 64 bits.  On x86 with AVX2 the lanes
+ * are two vectors; elsewhere a scalar loop computes the same hash.  Equal
+ * hashes only suggest equal pages: callers compare the bytes before
+ * relying on it.
+ */
+
+#ifndef _PAGE_HASH_H_
+#define _PAGE_HASH_H_
+
+#include <stdint.h>
+#include "vm_pager.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define PAGE_HASH_X86
+#endif
+
+#define PAGE_HASH_LANES  16
+#define PAGE_HASH_PRIME1 2654435761U
+#define PAGE_HASH_PRIME2 2246822519U
+
+inline uint64_t page_hash_fold(const uint32_t* lanes)
+{
+    uint64_t h = 0;
+    for (unsigned int k = 0; k < PAGE_HASH_LANES; k++)
+        h = (h ^ lanes[k]) * 0x9e3779b97f4a7c15ULL;
+    return h ^ (h >> 29);
+}
+
+inline uint64_t page_hash_scalar(const void* page)
+{
+    const uint32_t* p = (const uint32_t*) page;
+    uint32_t lanes[PAGE_HASH_LANES];
+    for (unsigned int k = 0; k < PAGE_HASH_LANES; k++)
+        lanes[k] = k;
+    for (unsigned int i = 0; i < VM_PAGESIZE / sizeof(uint32_t); i += PAGE_HASH_LANES) {
+        for (unsigned int k = 0; k < PAGE_HASH_LANES; k++) {
+            uint32_t acc = lanes[k] + p[i + k] * PAGE_HASH_PRIME2;
+            lanes[k] = ((acc << 13) | (acc >> 19)) * PAGE_HASH_PRIME1;
+        }
+    }
+    return page_hash_fold(lanes);
+}
+
+#ifdef PAGE_HASH_X86
+
+__attribute__((target("avx2")))
+inline uint64_t page_hash_avx2(const void* page)
+{
+    const __m256i* p = (const __m256i*) page;
+    const __m256i prime1 = _mm256_set1_epi32(PAGE_HASH_PRIME1);
+    const __m256i prime2 = _mm256_set1_epi32(PAGE_HASH_PRIME2);
+    __m256i lo = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    __m256i hi = _mm256_setr_epi32(8, 9, 10, 11, 12, 13, 14, 15);
+    for (unsigned int i = 0; i < VM_PAGESIZE / sizeof(__m256i); i += 2) {
+        lo = _mm256_add_epi32(lo, _mm256_mullo_epi32(_mm256_load_si256(p + i), prime2));
+        hi = _mm256_add_epi32(hi, _mm256_mullo_epi32(_mm256_load_si256(p + i + 1), prime2));
+        lo = _mm256_or_si256(_mm256_slli_epi32(lo, 13), _mm256_srli_epi32(lo, 19));
+        hi = _mm256_or_si256(_mm256_slli_epi32(hi, 13), _mm256_srli_epi32(hi, 19));
+        lo = _mm256_mullo_epi32(lo, prime1);
+        hi = _mm256_mullo_epi32(hi, prime1);
+    }
+    uint32_t lanes[PAGE_HASH_LANES];
+    _mm256_storeu_si256((__m256i*) lanes, lo);
+    _mm256_storeu_si256((__m256i*) (lanes + 8), hi);
+    return page_hash_fold(lanes);
+}
+
+#endif /* PAGE_HASH_X86 */
+
+/*
+ * 64-bit hash of the page-aligned page at "page".  The implementation is
+ * picked on the first call.
+ */
+inline uint64_t page_hash(const void* page)
+{
+#ifdef PAGE_HASH_X86
+    static uint64_t (*hash)(const void*) =
+        __builtin_cpu_supports("avx2") ? page_hash_avx2 : page_hash_scalar;
+    return hash(page);
+#else
+    return page_hash_scalar(page);
+#endif
+}
+
+#endif /* _PAGE_HASH_H_ */
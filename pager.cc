@@ -5,200 +5,2723 @@
  * Created on February 26, 2011, 2:46 PM
  */
 
+#include <cstdio>
 #include <cstdlib>
 #include <iostream>
 #include "vm_pager.h"
-#include <stack>
-#include <queue>
-#include <map>
+#include "pager.h"
+#include "page.h"
+#include "replace.h"
+#include "proc_table.h"
+#include "zero_page.h"
+#include "page_hash.h"
+#include "lz_page.h"
+#include "swap_map.h"
+#include "free_set.h"
+#include "state_file.h"
+#include "event_log.h"
 #include <assert.h>
+#include <algorithm>
 #include <iterator>
+#include <list>
+#include <unordered_map>
 #include <cstring>
+#include <sys/mman.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <time.h>
 using namespace std;
 
-struct page {
-    page_table_entry_t* pte_ptr;
-    bool written_to;
-    bool dirty;
-    bool resident;
-    bool reference;
-    bool valid;
-    unsigned int disk_block;
+//the process each thread runs as, set by vm_switch
+thread_local pid_t current_id;
+thread_local process_info* current_process;
+
+//processes by pid.  It changes only with every shard locked (see
+//pager_guard), so a thread holding a shard's lock may read it; vm_switch,
+//which holds none, reads it under process_lock, which those changing it
+//take for writing.
+proc_table process_map;
+pthread_rwlock_t process_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+//page replacement engines, one of which is selected by vm_init and runs in
+//every shard (see policy_shard)
+enum replacement { CLOCK, WSCLOCK, CLOCKPRO, ARC, LRUK };
+
+replacement policy;
+
+const char* pager_policy;
+
+//swap accounting: disk blocks are only bound to a page when it is first
+//written back, vm_extend just takes a reservation of at most swap_limit
+const char* pager_overcommit;
+unsigned int pager_swap_reserved;
+unsigned int swap_limit;
+
+//threads calling into the pager at once.  With more than one, or with a
+//thread of the pager's own (cleaner, dedup scanner, warm-up), the pager
+//locks (pager_locking); otherwise it takes no locks.
+unsigned int pager_threads;
+bool pager_locking;
+
+//take a swap reservation for n more pages; false if it would exceed the
+//limit.  Reservations are taken and given back under the locks of
+//different shards.
+bool reserve_swap(unsigned int n)
+{
+    if (!pager_locking) {
+        if (pager_swap_reserved >= swap_limit || swap_limit - pager_swap_reserved < n)
+            return false;
+        pager_swap_reserved += n;
+        return true;
+    }
+    unsigned int r = __atomic_load_n(&pager_swap_reserved, __ATOMIC_RELAXED);
+    do {
+        if (r >= swap_limit || swap_limit - r < n)
+            return false;
+    } while (!__atomic_compare_exchange_n(&pager_swap_reserved, &r, r + n, true,
+            __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+    return true;
+}
+
+void unreserve_swap(unsigned int n)
+{
+    if (pager_locking)
+        __atomic_sub_fetch(&pager_swap_reserved, n, __ATOMIC_RELAXED);
+    else
+        pager_swap_reserved -= n;
+}
+
+frame* core_map;
+
+unsigned int num_pages;
+unsigned int num_blocks;
+
+pager_stats pager_totals;
+const char* pager_stats_format;
+
+//event recording, see pager_events in pager.h
+const char* pager_events;
+unsigned int pager_event_order = 20;
+event_ring event_log;
+//numbers the threads that record events, from 1
+thread_local uint16_t event_thread;
+uint16_t event_threads;
+
+//start time of an event, 0 when not recording
+inline uint64_t event_start()
+{
+    return event_log.enabled() ? event_clock() : 0;
+}
+
+//record an event of process pid that started at "start" and ends now
+inline void log_event(uint8_t type, uint8_t detail, pid_t pid, uint32_t arg, uint64_t start)
+{
+    if (!event_log.enabled())
+        return;
+    if (event_thread == 0)
+        event_thread = __atomic_add_fetch(&event_threads, 1, __ATOMIC_RELAXED);
+    uint64_t end = event_clock();
+    event_log.record(type, detail, pid, arg, start == 0 ? end : start, end, event_thread);
+}
+
+//read-ahead window bounds, in pages
+#define RA_MIN_PAGES 4
+#define RA_MAX_PAGES 64
+
+//page tables of destroyed processes, kept for reuse by vm_create
+#define PTBL_POOL_MAX 64
+//entries a pooled table may keep committed; beyond this they are released
+#define PTBL_POOL_KEEP (65536 / sizeof(page_table_entry_t))
+
+vector<page_table_t*> ptbl_pool;
+
+//resident set limits of new processes (see pager.h)
+unsigned int pager_rss_min;
+unsigned int pager_rss_max;
+
+//frames of p beyond its guarantee
+unsigned int excess_frames(const process_info* p)
+{
+    return p->rss > p->rss_min ? p->rss - p->rss_min : 0;
+}
+
+unsigned int pager_page_tables;
+
+//page tables are demand-zero mappings: memory is committed only for the
+//entries a process extends into
+page_table_t* alloc_page_table()
+{
+    pager_page_tables++;
+    if (!ptbl_pool.empty()) {
+        page_table_t* ptbl = ptbl_pool.back();
+        ptbl_pool.pop_back();
+        return ptbl;
+    }
+    void* ptbl = mmap(NULL, sizeof(page_table_t), PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (ptbl == MAP_FAILED) {
+        cerr << "error: out of memory for page tables" << endl;
+        exit(1);
+    }
+    return (page_table_t*) ptbl;
+}
+
+//return a page table whose entries 0..top_valid_index were used to the pool,
+//zeroed, so that no stale entry grants access to its next owner
+void free_page_table(page_table_t* ptbl, int top_valid_index)
+{
+    pager_page_tables--;
+    size_t used = (top_valid_index + 1) * sizeof(page_table_entry_t);
+    if (ptbl_pool.size() >= PTBL_POOL_MAX) {
+        munmap(ptbl, sizeof(page_table_t));
+        return;
+    }
+    if (top_valid_index + 1 <= (int) PTBL_POOL_KEEP) {
+        memset(ptbl->ptes, 0, used);
+    } else {
+        //drop the committed memory; the range reads back as zeros
+        madvise(ptbl, sizeof(page_table_t), MADV_DONTNEED);
+    }
+    ptbl_pool.push_back(ptbl);
+}
+
+//state file, see pager_state in pager.h.  Only processes that run have a
+//slot in it; the pages of shared segments are not kept.
+const char* pager_state;
+state_file state;
+void restore_processes();
+
+//what vm_init resumed from the state file, and the pages then resident,
+//by process and page, for the warm-up (see pager_warm)
+restore_usage restored;
+vector<pair<pid_t, unsigned int> > warm_list;
+unsigned int pager_warm;
+void* warmer(void*);
+
+//record page vpn of proc in the state file: its disk block, which must
+//hold the page's contents by now, and whether it is resident
+void save_page(process_info* proc, unsigned int vpn, bool resident)
+{
+    if (proc->state_slot == NO_SLOT)
+        return;
+    unsigned int block = proc->pages[vpn].disk_block;
+    state.records(proc->state_slot)[vpn] = (block == NO_BLOCK ? STATE_NONE : block + 1)
+            | (resident ? STATE_RESIDENT : 0);
+}
+
+//the disk is cut into regions of consecutive blocks, as many as there are
+//shards (see pager_shard), each with a lock of its own, its free blocks
+//and the blocks of it shared by the pages of forked processes (the number
+//of pages holding each beyond the first).  A region's lock is taken last,
+//and only around the region's own bookkeeping.
+struct swap_region {
+    pthread_mutex_t lock;
+    unsigned int first;
+    swap_map free;                  // by block - first
+    unordered_map<unsigned int, unsigned int> shares;
+};
+
+swap_region* regions;
+unsigned int num_regions;
+unsigned int region_blocks;         // blocks of every region but the last
+
+swap_region& region_of(unsigned int block)
+{
+    return regions[min(block / region_blocks, num_regions - 1)];
+}
+
+struct region_guard {
+    swap_region& r;
+
+    region_guard(swap_region& region) : r(region)
+    {
+        if (pager_locking)
+            pthread_mutex_lock(&r.lock);
+    }
+
+    ~region_guard()
+    {
+        if (pager_locking)
+            pthread_mutex_unlock(&r.lock);
+    }
+};
+
+//take disk block "block" if it is free
+bool take_block(unsigned int block)
+{
+    swap_region& r = region_of(block);
+    region_guard guard(r);
+    if (!r.free.is_free(block - r.first))
+        return false;
+    r.free.take(block - r.first);
+    return true;
+}
+
+//bind a free disk block to page vpn of proc, keeping the process's pages in
+//arena order on disk where possible: right after the block of the page
+//before it, else at the position given by the process's swap base.  If
+//both are taken, the page starts a new run, centred in the largest free
+//extent, of the region of the process's shard first, on the pages from
+//vpn to the end of the arena.  Returns false if the disk is full.
+bool bind_block(process_info* proc, unsigned int vpn)
+{
+    long long goal = -1;
+    bool bound = false;
+    if (vpn > 0 && proc->pages[vpn - 1].disk_block != NO_BLOCK) {
+        goal = (long long) proc->pages[vpn - 1].disk_block + 1;
+        bound = goal < num_blocks && take_block(goal);
+    }
+    if (!bound && proc->swap_base != NO_SWAP_BASE) {
+        goal = proc->swap_base + vpn;
+        bound = goal >= 0 && goal < num_blocks && take_block(goal);
+    }
+    if (!bound) {
+        unsigned int need = proc->top_valid_index + 1 - vpn;
+        for (unsigned int i = 0; i < num_regions && !bound; i++) {
+            swap_region& r = regions[(proc->shard + i) % num_regions];
+            region_guard guard(r);
+            pair<unsigned int, unsigned int> hole = r.free.largest();
+            if (hole.second == 0)
+                continue;
+            goal = hole.first;
+            if (hole.second > need)
+                goal += (hole.second - need) / 2;
+            r.free.take(goal);
+            goal += r.first;
+            bound = true;
+        }
+        if (!bound)
+            return false;
+        proc->swap_base = goal - vpn;
+        if (proc->state_slot != NO_SLOT)
+            state.slot(proc->state_slot).swap_base = proc->swap_base;
+    }
+
+    proc->pages[vpn].disk_block = goal;
+    return true;
+}
+
+void share_block(unsigned int block)
+{
+    swap_region& r = region_of(block);
+    region_guard guard(r);
+    r.shares[block]++;
+}
+
+bool block_shared(unsigned int block)
+{
+    swap_region& r = region_of(block);
+    region_guard guard(r);
+    return r.shares.find(block) != r.shares.end();
+}
+
+//drop a page's hold on a disk block, freeing the block with its last holder
+void release_block(unsigned int block)
+{
+    swap_region& r = region_of(block);
+    region_guard guard(r);
+    unordered_map<unsigned int, unsigned int>::iterator s = r.shares.find(block);
+    if (s == r.shares.end())
+        r.free.release(block - r.first);
+    else if (--s->second == 0)
+        r.shares.erase(s);
+}
+
+//cut the disk's blocks into n regions
+void init_regions(unsigned int blocks, unsigned int n)
+{
+    num_regions = max(1U, min(n, blocks));
+    region_blocks = max(1U, blocks / num_regions);
+    regions = new swap_region[num_regions];
+    for (unsigned int i = 0; i < num_regions; i++) {
+        swap_region& r = regions[i];
+        pthread_mutex_init(&r.lock, NULL);
+        r.first = i * region_blocks;
+        r.free.init(i + 1 < num_regions ? region_blocks : blocks - r.first);
+    }
+}
+
+//shared segments (see vm_shm_attach).  A segment's pages are those of a
+//process of its own, which is not in process_map and never runs: faults on
+//the windows onto it fault its pages in as that process's (see shm_fault),
+//and the engine, write-back and eviction treat them like any other pages.
+struct shm_segment {
+    string name;
+    process_info* proc;
+    unsigned int attached;      // processes with a window onto it
+    bool unlinked;
+};
+
+//segments by name, until they are unlinked
+unordered_map<string, shm_segment*> segments;
+//pids of the segments' processes count down from -2, clear of the pids
+//of real processes and of the totals' -1
+pid_t next_segment_pid = -2;
+
+//pages of proc's windows onto shared segments, which hold no swap
+//reservation of their own
+unsigned int window_pages(const process_info* proc)
+{
+    unsigned int n = 0;
+    for (size_t i = 0; i < proc->windows.size(); i++)
+        n += proc->windows[i].pages;
+    return n;
+}
+
+//the window of proc holding page vpn
+const shm_window& find_window(const process_info* proc, unsigned int vpn)
+{
+    size_t i = 0;
+    while (vpn - proc->windows[i].first_vpn >= proc->windows[i].pages)
+        i++;
+    return proc->windows[i];
+}
+
+swap_usage pager_swap_usage()
+{
+    swap_usage u = swap_usage();
+    for (unsigned int i = 0; i < num_regions; i++) {
+        swap_region& r = regions[i];
+        region_guard guard(r);
+        u.free_blocks += r.free.free_blocks();
+        u.extents += r.free.extents();
+        u.largest_extent = max(u.largest_extent, r.free.largest().second);
+    }
+    return u;
+}
+
+//background cleaner: writes dirty pages back ahead of eviction, so that
+//foreground faults find clean victims.  Only started if pager_clean_low is
+//set.
+unsigned int pager_clean_low;
+unsigned int pager_clean_high;
+
+bool cleaner_running;
+pthread_t cleaner_thread;
+//an eviction leaving its shard short of clean frames sets cleaner_wanted
+//and signals cleaner_wake, under cleaner_lock; pager_shutdown sets
+//cleaner_stop
+pthread_mutex_t cleaner_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t cleaner_wake = PTHREAD_COND_INITIALIZER;
+bool cleaner_wanted;
+bool cleaner_stop;
+
+//dedup scanner, see pager_dedup_pages in pager.h.  It sleeps on
+//dedup_wake between scans, which pager_shutdown signals after setting
+//dedup_stop, under dedup_sleep_lock.
+unsigned int pager_dedup_pages;
+unsigned int pager_dedup_sleep_ms;
+void* dedup_scanner(void*);
+bool dedup_running;
+pthread_t dedup_thread;
+pthread_mutex_t dedup_sleep_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t dedup_wake = PTHREAD_COND_INITIALIZER;
+bool dedup_stop;
+
+//compressed swap cache, see pager_zcache_frames in pager.h.  The frames
+//set aside for it are shared out among the shards, and each shard's are
+//cut into slots; each cached page takes a run of consecutive slots of its
+//process's shard.  A page copied by vm_fork while cached shares its entry
+//with the copies, as it would share a disk block.
+#define ZCACHE_SLOT 256
+#define ZCACHE_MAX_BYTES (VM_PAGESIZE / 4 * 3)
+
+struct zentry {
+    unsigned int slot;              // first slot
+    unsigned int length;            // compressed bytes
+    vector<mapping> pages;          // pages whose copy it is
+    list<unsigned int>::iterator age;
+};
+
+unsigned int pager_zcache_frames;
+//(pages are compressed with the shard's lock dropped, by any thread)
+thread_local char zcache_buffer[ZCACHE_MAX_BYTES];
+
+//shards of physical memory, see pager_shards in pager.h.  Each shard is a
+//range of consecutive frames with its own lock, free frames, replacement
+//engine, cleaner state and slice of the compressed swap cache.  A process
+//takes all its frames from one shard (see process_info), so its pages, the
+//frames holding them and everything that goes by them are guarded by that
+//shard's lock alone, and faults of processes in different shards do not
+//contend.
+#define SHARD_MIN_FRAMES 64
+
+struct pager_shard {
+    pthread_mutex_t lock;
+    //broadcast when a busy page (see vpage) of the shard stops being busy,
+    //or a frame of it is freed or handed to the engine
+    pthread_cond_t io_done;
+    unsigned int first;             // frames first..first+frames-1
+    unsigned int frames;
+    free_set free_pages;            // by frame - first
+    //frames held by the replacement engine, i.e. those evict can take.
+    //Frames being filled or evicted with the lock dropped are not among them.
+    unsigned int engine_frames;
+    //frames held beyond their process's guarantee; while there are any,
+    //eviction passes over processes within their guarantee
+    unsigned int reclaimable;
+
+    //cleaner: its hand, and an estimate of free and clean evictable frames,
+    //refreshed by each cleaner pass and decremented by evictions; the
+    //cleaner runs when it drops below clean_low and stops at clean_high
+    //(pager_clean_low and pager_clean_high shared out among the shards)
+    unsigned int clean_hand;
+    unsigned int clean_reserve;
+    unsigned int clean_low;
+    unsigned int clean_high;
+
+    //compressed swap cache
+    unsigned int zcache_frames;
+    char* zcache_base;
+    swap_map zcache_slots;
+    vector<zentry> zcache;
+    vector<unsigned int> zcache_unused;         // entries of zcache to reuse
+    list<unsigned int> zcache_fifo;             // entries in use, oldest first
+    unordered_map<page_key, unsigned int> zcache_index;
+    unsigned int zcache_pages;
+    unsigned long long zcache_stored;
+
+    //the dedup scanner's frames of its current pass over the shard, by hash
+    unordered_map<uint64_t, unsigned int> dedup_index;
+};
+
+//a shard and the engine of the selected policy over its frames
+template <class Policy>
+struct policy_shard : pager_shard {
+    Policy engine;
+};
+
+unsigned int pager_shards;
+pager_shard** shards;
+unsigned int shard_frames;          // frames of every shard but the last
+
+template <class Policy>
+policy_shard<Policy>& shard_at(unsigned int k)
+{
+    return *static_cast<policy_shard<Policy>*>(shards[k]);
+}
+
+pager_shard& shard_of(const process_info* proc)
+{
+    return *shards[proc->shard];
+}
+
+pager_shard& frame_shard(unsigned int f)
+{
+    return *shards[min(f / shard_frames, pager_shards - 1)];
+}
+
+//charge one more (n = 1) or one less (n = -1) frame to p
+void charge_frame(process_info* p, int n)
+{
+    pager_shard& s = shard_of(p);
+    s.reclaimable -= excess_frames(p);
+    p->rss += n;
+    s.reclaimable += excess_frames(p);
+}
+
+unsigned int take_frame(pager_shard& s)
+{
+    return s.first + s.free_pages.take();
+}
+
+void free_frame(pager_shard& s, unsigned int f)
+{
+    s.free_pages.release(f - s.first);
+}
+
+//wake the threads waiting on s (see wait_on)
+void wake_waiters(pager_shard& s)
+{
+    if (pager_locking)
+        pthread_cond_broadcast(&s.io_done);
+}
+
+//the shard locks the thread holds: that of held_shard, or every one if
+//held_all is set
+thread_local pager_shard* held_shard;
+thread_local bool held_all;
+
+void lock_shard(pager_shard& s)
+{
+    if (!pager_locking)
+        return;
+    pthread_mutex_lock(&s.lock);
+    held_shard = &s;
+}
+
+void unlock_shard()
+{
+    if (!pager_locking)
+        return;
+    pthread_mutex_unlock(&held_shard->lock);
+    held_shard = NULL;
+}
+
+//(in index order, so that threads taking all of them cannot deadlock)
+void lock_all()
+{
+    if (!pager_locking)
+        return;
+    for (unsigned int k = 0; k < pager_shards; k++)
+        pthread_mutex_lock(&shards[k]->lock);
+    held_all = true;
+}
+
+void unlock_all()
+{
+    if (!pager_locking)
+        return;
+    for (unsigned int k = pager_shards; k > 0; k--)
+        pthread_mutex_unlock(&shards[k - 1]->lock);
+    held_all = false;
+}
+
+//serialises the pager's entry points when pager_locking is set.  Calls
+//made as the same process ("proc") are serialised on its lock, so a fault
+//never sees its own process change under it.  The call then takes the
+//lock of the process's shard, or every shard's if there is no process or
+//"all" is set, for calls that change what shards share: the process table,
+//the state file's slots, page tables and shared segments, or that read
+//every shard.  Faults drop the shard lock around disk I/O, compression
+//and page zeroing so that other faults of the shard can run meanwhile.
+struct pager_guard {
+    process_info* proc;
+    bool all;
+
+    pager_guard(process_info* p = NULL, bool every = false)
+        : proc(pager_locking ? p : NULL), all(p == NULL || every)
+    {
+        if (proc != NULL)
+            pthread_mutex_lock(&proc->lock);
+        if (all)
+            lock_all();
+        else
+            lock_shard(shard_of(p));
+    }
+
+    ~pager_guard()
+    {
+        if (all)
+            unlock_all();
+        else
+            unlock_shard();
+        if (proc != NULL)
+            pthread_mutex_unlock(&proc->lock);
+    }
 };
 
-stack<unsigned int> free_pages;
-stack<unsigned int> free_disk_blocks;
+//let other threads into the shards this one holds while it works on
+//frames that only it can reach
+void drop_pager_lock()
+{
+    if (!pager_locking)
+        return;
+    if (!held_all) {
+        pthread_mutex_unlock(&held_shard->lock);
+        return;
+    }
+    for (unsigned int k = pager_shards; k > 0; k--)
+        pthread_mutex_unlock(&shards[k - 1]->lock);
+}
+
+void take_pager_lock()
+{
+    if (!pager_locking)
+        return;
+    if (!held_all) {
+        pthread_mutex_lock(&held_shard->lock);
+        return;
+    }
+    for (unsigned int k = 0; k < pager_shards; k++)
+        pthread_mutex_lock(&shards[k]->lock);
+}
+
+//wait for a page of s to stop being busy or a frame of s to come free.  A
+//thread holding every shard lets go of the others while it waits, so that
+//the thread it waits for can take them.
+void wait_on(pager_shard& s)
+{
+    if (!held_all) {
+        pthread_cond_wait(&s.io_done, &s.lock);
+        return;
+    }
+    for (unsigned int k = pager_shards; k > 0; k--) {
+        if (shards[k - 1] != &s)
+            pthread_mutex_unlock(&shards[k - 1]->lock);
+    }
+    pthread_cond_wait(&s.io_done, &s.lock);
+    pthread_mutex_unlock(&s.lock);
+    for (unsigned int k = 0; k < pager_shards; k++)
+        pthread_mutex_lock(&shards[k]->lock);
+}
+
+//wait until page vpn of proc is no longer busy
+void wait_for_io(process_info* proc, unsigned int vpn)
+{
+    while (proc->pages[vpn].busy)
+        wait_on(shard_of(proc));
+}
+
+void end_io(process_info* proc, unsigned int vpn)
+{
+    proc->pages[vpn].busy = false;
+    wake_waiters(shard_of(proc));
+}
+
+//write back the dirty page in frame f, whose access is revoked so it can only
+//be changed through a fault.  It is marked clean, and busy until the write
+//is done, so faults on it wait for the write.  Returns false if it needs a
+//disk block and none is free.
+bool clean_frame(unsigned int f)
+{
+    //(accesses through translations made before the revocation finish first)
+    if (pager_locking)
+        pm_shootdown(f);
+    vpage& p = core_map[f].page();
+    if (page_is_zero(frame_addr(f))) {
+        if (p.disk_block != NO_BLOCK) {
+            release_block(p.disk_block);
+            p.disk_block = NO_BLOCK;
+            save_page(core_map[f].proc, core_map[f].vpn, true);
+        }
+        p.written_to = false;
+        p.dirty = false;
+        count_event(core_map[f].proc, &pager_stats::zero_pages);
+        return true;
+    }
+    if (p.disk_block == NO_BLOCK) {
+        if (!bind_block(core_map[f].proc, core_map[f].vpn))
+            return false;
+    }
+    p.dirty = false;
+    p.busy = true;
+    unsigned int block = p.disk_block;
+
+    pid_t pid = core_map[f].proc->pid;
+    drop_pager_lock();
+    uint64_t start = event_start();
+    disk_write(block, f);
+    log_event(EVENT_DISK_WRITE, 1, pid, block, start);
+    take_pager_lock();
+    save_page(core_map[f].proc, core_map[f].vpn, true);
+    end_io(core_map[f].proc, core_map[f].vpn);
+    count_event(core_map[f].proc, &pager_stats::bg_writebacks);
+    return true;
+}
+
+//one revolution of the cleaner's hand over shard s at most.  Pages whose
+//access the replacement engine has revoked are the next eviction
+//candidates; pages still in use are left alone.
+void clean_shard(pager_shard& s)
+{
+    unsigned int reserve = 0;
+    for (unsigned int n = 0; n < s.frames && reserve < s.clean_high; n++) {
+        unsigned int f = s.first + s.clean_hand;
+        if (++s.clean_hand == s.frames)
+            s.clean_hand = 0;
+
+        if (core_map[f].proc == NULL) {
+            reserve++;
+            continue;
+        }
+        page_table_entry_t& pte = core_map[f].pte();
+        if (pte.read_enable || pte.write_enable || core_map[f].page().busy
+                || core_map[f].more != NULL)
+            continue;
+        if (!needs_writeback(core_map[f].page()) || clean_frame(f))
+            reserve++;
+
+        //let faults in between chunks of the scan
+        if (n % 64 == 63) {
+            pthread_mutex_unlock(&s.lock);
+            pthread_mutex_lock(&s.lock);
+        }
+    }
+    s.clean_reserve = s.clean_high;
+}
+
+//ask the cleaner for a pass over the shards short of clean frames
+void wake_cleaner()
+{
+    pthread_mutex_lock(&cleaner_lock);
+    cleaner_wanted = true;
+    pthread_cond_signal(&cleaner_wake);
+    pthread_mutex_unlock(&cleaner_lock);
+}
+
+void* cleaner(void*)
+{
+    pthread_mutex_lock(&cleaner_lock);
+    for (;;) {
+        while (!cleaner_wanted && !cleaner_stop)
+            pthread_cond_wait(&cleaner_wake, &cleaner_lock);
+        if (cleaner_stop)
+            break;
+        cleaner_wanted = false;
+        pthread_mutex_unlock(&cleaner_lock);
+
+        for (unsigned int k = 0; k < pager_shards; k++) {
+            pager_shard& s = *shards[k];
+            lock_shard(s);
+            if (s.clean_reserve < s.clean_low)
+                clean_shard(s);
+            unlock_shard();
+        }
+        pthread_mutex_lock(&cleaner_lock);
+    }
+    pthread_mutex_unlock(&cleaner_lock);
+    return NULL;
+}
+
+//counters in the order they are dumped
+struct stats_field {
+    const char* name;
+    unsigned long long pager_stats::*field;
+};
+
+const stats_field stats_fields[] = {
+    {"faults", &pager_stats::faults},
+    {"major_faults", &pager_stats::major_faults},
+    {"zero_fills", &pager_stats::zero_fills},
+    {"minor_faults", &pager_stats::minor_faults},
+    {"reference_faults", &pager_stats::reference_faults},
+    {"revocations", &pager_stats::revocations},
+    {"evictions", &pager_stats::evictions},
+    {"limit_evictions", &pager_stats::limit_evictions},
+    {"zero_pages", &pager_stats::zero_pages},
+    {"writebacks_fg", &pager_stats::fg_writebacks},
+    {"writebacks_bg", &pager_stats::bg_writebacks},
+    {"readahead", &pager_stats::readahead_pages},
+    {"readahead_hits", &pager_stats::readahead_hits},
+    {"cow_copies", &pager_stats::cow_copies},
+    {"merged_pages", &pager_stats::merged_pages},
+    {"zcache_stores", &pager_stats::zcache_stores},
+    {"zcache_bytes", &pager_stats::zcache_bytes},
+    {"zcache_rejects", &pager_stats::zcache_rejects},
+    {"zcache_hits", &pager_stats::zcache_hits},
+    {"zcache_writebacks", &pager_stats::zcache_writebacks},
+    {"released_pages", &pager_stats::released_pages},
+    {"hand_steps", &pager_stats::hand_steps},
+};
+
+//automatic dumps selected by pager_stats_format
+bool stats_dumps;
+bool stats_json;
+
+//write one set of counters, for process "pid", or the totals if pid is
+//negative, followed by the resident set of "proc" if given
+void write_stats(ostream& out, const pager_stats& stats, pid_t pid, bool json,
+        const process_info* proc = NULL)
+{
+    const char* sep = json ? "{" : "";
+    if (pid >= 0) {
+        out << sep << (json ? "\"pid\": " : "pid ") << pid;
+        sep = json ? ", " : "\t";
+    } else if (!json) {
+        out << "total";
+        sep = "\t";
+    }
+    for (size_t i = 0; i < sizeof(stats_fields) / sizeof(stats_fields[0]); i++) {
+        const stats_field& s = stats_fields[i];
+        if (pid >= 0 && s.field == &pager_stats::hand_steps)
+            continue;
+        if (json)
+            out << sep << "\"" << s.name << "\": " << stats.*s.field;
+        else
+            out << sep << s.name << " " << stats.*s.field;
+        sep = json ? ", " : "\t";
+    }
+    if (proc != NULL) {
+        if (json)
+            out << ", \"rss\": " << proc->rss << ", \"rss_min\": " << proc->rss_min
+                << ", \"rss_max\": " << proc->rss_max;
+        else
+            out << "\trss " << proc->rss << "\trss_min " << proc->rss_min
+                << "\trss_max " << proc->rss_max;
+    }
+    if (json)
+        out << "}";
+}
+
+bool pager_process_stats(pid_t pid, pager_stats* stats)
+{
+    pager_guard guard;
+    process_info* process = process_map.find(pid);
+    if (process == NULL)
+        return false;
+    *stats = process->stats;
+    return true;
+}
+
+bool pager_set_rss_limits(pid_t pid, unsigned int min, unsigned int max)
+{
+    pager_guard guard;
+    process_info* process = process_map.find(pid);
+    if (process == NULL || (max != 0 && min > max))
+        return false;
+    pager_shard& shard = shard_of(process);
+    shard.reclaimable -= excess_frames(process);
+    process->rss_min = min;
+    process->rss_max = max;
+    shard.reclaimable += excess_frames(process);
+    return true;
+}
+
+bool pager_process_rss(pid_t pid, rss_usage* rss)
+{
+    pager_guard guard;
+    process_info* process = process_map.find(pid);
+    if (process == NULL)
+        return false;
+    rss->resident = process->rss;
+    rss->min = process->rss_min;
+    rss->max = process->rss_max;
+    return true;
+}
+
+pager_stats pager_total_stats()
+{
+    pager_guard guard;
+    return pager_totals;
+}
+
+bool by_pid(const process_info* a, const process_info* b)
+{
+    return a->pid < b->pid;
+}
+
+void pager_dump_stats(ostream& out, bool json)
+{
+    pager_guard guard;
+    vector<process_info*> procs;
+    process_map.for_each([&procs](process_info* p) { procs.push_back(p); });
+    sort(procs.begin(), procs.end(), by_pid);
+
+    if (json)
+        out << "{\"processes\": [";
+    for (size_t i = 0; i < procs.size(); i++) {
+        if (json && i > 0)
+            out << ", ";
+        write_stats(out, procs[i]->stats, procs[i]->pid, json, procs[i]);
+        if (!json)
+            out << endl;
+    }
+    if (json)
+        out << "], \"total\": ";
+    write_stats(out, pager_totals, -1, json);
+    if (json)
+        out << "}";
+    out << endl;
+}
+
+//at exit, without the lock: a thread may have exited holding it
+void dump_total_stats()
+{
+    write_stats(cerr, pager_totals, -1, stats_json);
+    cerr << endl;
+}
+
+bool pager_save_events(const char* path)
+{
+    if (!event_log.enabled())
+        return false;
+    FILE* f = fopen(path, "wb");
+    if (f == NULL)
+        return false;
+    vector<pager_event> events(event_log.capacity());
+    event_file_header h;
+    uint32_t n = event_log.snapshot(&events[0], &h);
+    bool ok = fwrite(&h, sizeof(h), 1, f) == 1
+        && fwrite(&events[0], sizeof(pager_event), n, f) == n;
+    return fclose(f) == 0 && ok;
+}
+
+void save_events()
+{
+    if (!pager_save_events(pager_events))
+        cerr << "error: cannot save events to " << pager_events << endl;
+}
+
+//set shard k of the pager_shards shards cutting the "frames" frames below
+//the compressed swap cache up, with its share of the cache
+void init_shard(pager_shard& s, unsigned int k, unsigned int frames)
+{
+    pthread_mutex_init(&s.lock, NULL);
+    pthread_cond_init(&s.io_done, NULL);
+    s.first = k * shard_frames;
+    s.frames = k + 1 < pager_shards ? shard_frames : frames - s.first;
+    s.free_pages.init(s.frames);
+    s.engine_frames = 0;
+    s.reclaimable = 0;
+    s.clean_hand = 0;
+    s.clean_reserve = 0;
+    s.clean_low = 0;
+    s.clean_high = 0;
+
+    unsigned int share = pager_zcache_frames / pager_shards;
+    s.zcache_frames = k + 1 < pager_shards ? share : pager_zcache_frames - k * share;
+    s.zcache_base = frame_addr(frames + k * share);
+    s.zcache_slots.init(s.zcache_frames * (VM_PAGESIZE / ZCACHE_SLOT));
+    s.zcache_pages = 0;
+    s.zcache_stored = 0;
+}
+
+template <class Policy>
+void init_shards(unsigned int frames)
+{
+    shards = new pager_shard*[pager_shards];
+    for (unsigned int k = 0; k < pager_shards; k++) {
+        policy_shard<Policy>* s = new policy_shard<Policy>;
+        init_shard(*s, k, frames);
+        s->engine.init(s->first, s->frames);
+        shards[k] = s;
+    }
+}
+
+/*
+ * vm_init
+ *
+ * Called when the pager starts.  It should set up any internal data structures
+ * needed by the pager, e.g. physical page bookkeeping, process table, disk
+ * usage table, etc.
+ *
+ * vm_init is passed both the number of physical memory pages and the number
+ * of disk blocks in the raw disk.
+ */
+void vm_init(unsigned int memory_pages, unsigned int disk_blocks) {
+    //set the compressed swap cache aside: the pager manages the frames below it
+    if (pager_zcache_frames == 0 && getenv("PAGER_ZCACHE_FRAMES") != NULL)
+        pager_zcache_frames = strtoul(getenv("PAGER_ZCACHE_FRAMES"), NULL, 0);
+    if (pager_zcache_frames > memory_pages / 2) {
+        cerr << "error: compressed swap cache of " << pager_zcache_frames
+             << " frames above half of the " << memory_pages << " physical pages" << endl;
+        exit(1);
+    }
+    unsigned int frames = memory_pages - pager_zcache_frames;
+
+    //shard the frames, one shard per thread calling into the pager unless
+    //that leaves shards too small to page in
+    if (pager_threads == 0 && getenv("PAGER_THREADS") != NULL)
+        pager_threads = strtoul(getenv("PAGER_THREADS"), NULL, 0);
+    if (pager_shards == 0 && getenv("PAGER_SHARDS") != NULL)
+        pager_shards = strtoul(getenv("PAGER_SHARDS"), NULL, 0);
+    if (pager_shards == 0)
+        pager_shards = pager_threads;
+    pager_shards = max(1U, min(pager_shards, frames / SHARD_MIN_FRAMES));
+    shard_frames = frames / pager_shards;
+
+    //select the replacement engine
+    if (pager_policy == NULL)
+        pager_policy = getenv("PAGER_POLICY");
+    if (pager_policy == NULL || strcmp(pager_policy, "clock") == 0) {
+        policy = CLOCK;
+        init_shards<clock_policy>(frames);
+    } else if (strcmp(pager_policy, "wsclock") == 0) {
+        policy = WSCLOCK;
+        init_shards<wsclock_policy>(frames);
+    } else if (strcmp(pager_policy, "clockpro") == 0) {
+        policy = CLOCKPRO;
+        init_shards<clockpro_policy>(frames);
+    } else if (strcmp(pager_policy, "arc") == 0) {
+        policy = ARC;
+        init_shards<arc_policy>(frames);
+    } else if (strcmp(pager_policy, "lruk") == 0) {
+        policy = LRUK;
+        init_shards<lruk_policy>(frames);
+    } else {
+        cerr << "error: unknown replacement policy " << pager_policy
+             << " (clock, wsclock, clockpro, arc or lruk)" << endl;
+        exit(1);
+    }
+
+    //select the swap accounting
+    if (pager_overcommit == NULL)
+        pager_overcommit = getenv("PAGER_OVERCOMMIT");
+    if (pager_overcommit == NULL || strcmp(pager_overcommit, "strict") == 0) {
+        swap_limit = disk_blocks;
+    } else if (strcmp(pager_overcommit, "heuristic") == 0) {
+        swap_limit = disk_blocks + memory_pages;
+    } else if (strcmp(pager_overcommit, "unlimited") == 0) {
+        swap_limit = ~0U;
+    } else {
+        cerr << "error: unknown overcommit mode " << pager_overcommit
+             << " (strict, heuristic or unlimited)" << endl;
+        exit(1);
+    }
+    pager_swap_reserved = 0;
+
+    //resident set limits
+    if (pager_rss_min == 0 && getenv("PAGER_RSS_MIN") != NULL)
+        pager_rss_min = strtoul(getenv("PAGER_RSS_MIN"), NULL, 0);
+    if (pager_rss_max == 0 && getenv("PAGER_RSS_MAX") != NULL)
+        pager_rss_max = strtoul(getenv("PAGER_RSS_MAX"), NULL, 0);
+    if (pager_rss_max != 0 && pager_rss_min > pager_rss_max) {
+        cerr << "error: resident set guarantee " << pager_rss_min
+             << " above the limit " << pager_rss_max << endl;
+        exit(1);
+    }
+
+    //Init all free physical pages
+    //(calloc gets large zeroed blocks straight from the kernel, so a core map
+    //of free frames costs nothing until the frames are used)
+    core_map = (frame*) calloc(frames, sizeof(frame));
+    if (core_map == NULL) {
+        cerr << "error: cannot allocate the core map" << endl;
+        exit(1);
+    }
+    //init all free disk_blocks
+    init_regions(disk_blocks, pager_shards);
+
+    page_table_base_register = NULL;
+
+    num_pages=frames;
+    num_blocks=disk_blocks;
+
+    //resume the processes of the state file
+    if (pager_state == NULL)
+        pager_state = getenv("PAGER_STATE");
+    if (pager_state != NULL && *pager_state != '\0') {
+        const char* error = state.open(pager_state, disk_blocks);
+        if (error != NULL) {
+            cerr << "error: state file " << pager_state << ": " << error << endl;
+            exit(1);
+        }
+        restore_processes();
+    }
+
+    //select the automatic counter dumps
+    if (pager_stats_format == NULL)
+        pager_stats_format = getenv("PAGER_STATS");
+    if (pager_stats_format != NULL && *pager_stats_format != '\0') {
+        if (strcmp(pager_stats_format, "text") != 0 && strcmp(pager_stats_format, "json") != 0) {
+            cerr << "error: unknown stats format " << pager_stats_format
+                 << " (text or json)" << endl;
+            exit(1);
+        }
+        stats_json = strcmp(pager_stats_format, "json") == 0;
+        if (!stats_dumps)
+            atexit(dump_total_stats);
+        stats_dumps = true;
+    }
+
+    //start recording events
+    if (pager_events == NULL)
+        pager_events = getenv("PAGER_EVENTS");
+    if (pager_events != NULL && *pager_events != '\0' && !event_log.enabled()) {
+        if (!event_log.init(pager_event_order)) {
+            cerr << "error: cannot allocate the event ring" << endl;
+            exit(1);
+        }
+        atexit(save_events);
+    }
+
+    //lock if faults may come from several threads
+    pager_locking = pager_threads > 1;
+
+    //start the cleaner
+    if (pager_clean_low == 0 && getenv("PAGER_CLEAN_LOW") != NULL)
+        pager_clean_low = strtoul(getenv("PAGER_CLEAN_LOW"), NULL, 0);
+    if (pager_clean_low > 0) {
+        pager_clean_low = min(pager_clean_low, frames);
+        if (pager_clean_high < pager_clean_low)
+            pager_clean_high = min(2 * pager_clean_low, frames);
+        for (unsigned int k = 0; k < pager_shards; k++) {
+            pager_shard& s = *shards[k];
+            s.clean_low = max(1U, (unsigned int) ((unsigned long long) pager_clean_low * s.frames / frames));
+            s.clean_high = max(s.clean_low, (unsigned int) ((unsigned long long) pager_clean_high * s.frames / frames));
+        }
+        cleaner_wanted = true;
+        pager_locking = true;
+        if (pthread_create(&cleaner_thread, NULL, cleaner, NULL) != 0) {
+            cerr << "error: cannot start the cleaner thread" << endl;
+            exit(1);
+        }
+        cleaner_running = true;
+    }
+
+    //start the dedup scanner
+    if (pager_dedup_pages == 0 && getenv("PAGER_DEDUP_PAGES") != NULL)
+        pager_dedup_pages = strtoul(getenv("PAGER_DEDUP_PAGES"), NULL, 0);
+    if (pager_dedup_sleep_ms == 0 && getenv("PAGER_DEDUP_SLEEP_MS") != NULL)
+        pager_dedup_sleep_ms = strtoul(getenv("PAGER_DEDUP_SLEEP_MS"), NULL, 0);
+    if (pager_dedup_sleep_ms == 0)
+        pager_dedup_sleep_ms = 20;
+    if (pager_dedup_pages > 0) {
+        pager_locking = true;
+        if (pthread_create(&dedup_thread, NULL, dedup_scanner, NULL) != 0) {
+            cerr << "error: cannot start the dedup scanner thread" << endl;
+            exit(1);
+        }
+        dedup_running = true;
+    }
+
+    //warm the resumed processes up
+    if (pager_warm == 0 && getenv("PAGER_WARM") != NULL)
+        pager_warm = strtoul(getenv("PAGER_WARM"), NULL, 0);
+    if (pager_warm > 0 && !warm_list.empty()) {
+        pthread_t warm_thread;
+        pager_locking = true;
+        restored.warming = true;
+        if (pthread_create(&warm_thread, NULL, warmer, NULL) != 0) {
+            cerr << "error: cannot start the warm-up thread" << endl;
+            exit(1);
+        }
+        pthread_detach(warm_thread);
+    }
+}
+
+//a process with an empty arena
+process_info* new_process(pid_t pid)
+{
+    process_info* process = new process_info;
+    pthread_mutex_init(&process->lock, NULL);
+    //create page table
+    process->ptbl_ptr = alloc_page_table();
+    //initially no pte in page table is valid
+    process->top_valid_index = -1;
+    process->pid = pid;
+    process->shard = (unsigned int) pid % pager_shards;
+    process->ra_last = 0;
+    process->ra_stride = 0;
+    process->ra_window = RA_MIN_PAGES;
+    process->swap_base = NO_SWAP_BASE;
+    process->rss = 0;
+    process->rss_min = pager_rss_min;
+    process->rss_max = pager_rss_max;
+    process->rss_hand = 0;
+    process->segment = false;
+    process->state_slot = NO_SLOT;
+    process->stats = pager_stats();
+    return process;
+}
+
+//add proc to the process table, or remove process pid from it, with every
+//shard locked
+void add_process(process_info* proc)
+{
+    if (pager_locking)
+        pthread_rwlock_wrlock(&process_lock);
+    process_map.insert(proc->pid, proc);
+    if (pager_locking)
+        pthread_rwlock_unlock(&process_lock);
+}
+
+void remove_process(pid_t pid)
+{
+    if (pager_locking)
+        pthread_rwlock_wrlock(&process_lock);
+    process_map.erase(pid);
+    if (pager_locking)
+        pthread_rwlock_unlock(&process_lock);
+}
+
+//give proc a slot in the state file, if there is one
+void take_slot(process_info* proc)
+{
+    if (!state.mapped())
+        return;
+    unsigned int i = state.alloc_slot();
+    if (i == NO_SLOT) {
+        cerr << "error: cannot grow the state file " << pager_state << endl;
+        exit(1);
+    }
+    state_slot& s = state.slot(i);
+    s.pid = proc->pid;
+    s.pages = 0;
+    s.swap_base = proc->swap_base;
+    s.live = 1;
+    proc->state_slot = i;
+}
+
+/*
+ * vm_create
+ *
+ * Called when a new process, with process identifier "pid", is added to the
+ * system.  It should create whatever new elements are required for each of
+ * your data structures.  The new process will only run when it's switched
+ * to via vm_switch().
+ */
+void vm_create(pid_t pid) {
+    pager_guard guard;
+    process_info* process = new_process(pid);
+    take_slot(process);
+    add_process(process);
+}
+
+/*
+ * vm_fork
+ *
+ * Called when the current process forks a child with process identifier
+ * "pid".  The child's pages are copies of the parent's vpages: resident
+ * ones share the parent's frame, read-only in both, and pages on disk
+ * share the parent's block, or its entry in the compressed swap cache.
+ * Nothing is copied or read until one of them writes (see copy_on_write).
+ * The shared frames stay charged to the parent, and the child takes its
+ * frames from the parent's shard.  Windows onto shared segments are
+ * attached by the child too.
+ */
+int vm_fork(pid_t pid) {
+    process_info* parent = current_process;
+    pager_guard guard(parent, true);
+    pager_shard& shard = shard_of(parent);
+    unsigned int pages = parent->top_valid_index + 1;
+    unsigned int reserve = pages - window_pages(parent);
+    if (process_map.find(pid) != NULL || !reserve_swap(reserve))
+        return -1;
+
+    process_info* child = new_process(pid);
+    child->shard = parent->shard;
+    child->top_valid_index = parent->top_valid_index;
+    child->swap_base = parent->swap_base;
+    child->rss_min = parent->rss_min;
+    child->rss_max = parent->rss_max;
+    //windows onto shared segments stay shared, not copied
+    child->windows = parent->windows;
+    for (size_t i = 0; i < child->windows.size(); i++)
+        child->windows[i].seg->attached++;
+    child->pages.reserve(pages);
+    for (unsigned int vpn = 0; vpn < pages; vpn++) {
+        wait_for_io(parent, vpn);
+        vpage p = parent->pages[vpn];
+        page_table_entry_t& pte = parent->ptbl_ptr->ptes[vpn];
+        page_table_entry_t& child_pte = child->ptbl_ptr->ptes[vpn];
+        p.readahead = false;
+        if (p.disk_block != NO_BLOCK)
+            share_block(p.disk_block);
+        if (p.zcached) {
+            unsigned int e = shard.zcache_index[make_page_key(parent->pid, vpn)];
+            mapping m = {child, vpn};
+            shard.zcache[e].pages.push_back(m);
+            shard.zcache_index[make_page_key(pid, vpn)] = e;
+            shard.zcache_pages++;
+        }
+        child->pages.push_back(p);
+        if (p.resident) {
+            frame& fr = core_map[pte.ppage];
+            if (fr.more == NULL)
+                fr.more = new vector<mapping>;
+            mapping m = {child, vpn};
+            fr.more->push_back(m);
+            pte.write_enable = 0;
+            child_pte = pte;
+        } else {
+            child_pte.read_enable = 0;
+            child_pte.write_enable = 0;
+        }
+    }
+    take_slot(child);
+    for (unsigned int vpn = 0; vpn < pages; vpn++)
+        save_page(child, vpn, false);
+    if (child->state_slot != NO_SLOT)
+        state.slot(child->state_slot).pages = pages;
+    add_process(child);
+    return 0;
+}
+
+/*
+ * vm_switch
+ *
+ * Called when the kernel is switching to a new process, with process
+ * identifier "pid".  This allows the pager to do any bookkeeping needed to
+ * register the new process.
+ */
+void vm_switch(pid_t pid) {
+    //switching back to the process this thread ran last needs no lookup
+    if (current_process != NULL && pid == current_id) {
+        page_table_base_register = current_process->ptbl_ptr;
+        log_event(EVENT_SWITCH, 0, pid, 0, 0);
+        return;
+    }
+    if (pager_locking)
+        pthread_rwlock_rdlock(&process_lock);
+    process_info* process = process_map.find(pid);
+    if (pager_locking)
+        pthread_rwlock_unlock(&process_lock);
+    if (process != NULL) {
+        current_id = pid;
+        current_process = process;
+        page_table_base_register = current_process->ptbl_ptr;
+    }
+    log_event(EVENT_SWITCH, 0, pid, 0, 0);
+}
+
+//add "count" pages to the end of proc's arena, in a window onto a shared
+//segment if shm is set
+void append_pages(process_info* proc, unsigned int count, bool shm)
+{
+    vpage p;
+
+    //disk block allocation delayed to the first write-back
+    p.disk_block = NO_BLOCK;
+
+    //make non-resident
+    for (unsigned int k = 1; k <= count; k++) {
+        page_table_entry_t* pte = &(proc->ptbl_ptr->ptes[proc->top_valid_index + k]);
+        pte->read_enable = 0;
+        pte->write_enable = 0;
+    }
+
+    p.reference = false;
+    p.resident = false;
+    p.written_to = false;
+    p.valid = true;
+    p.dirty = false;
+    p.readahead = false;
+    p.busy = false;
+    p.shm = shm;
+    p.zcached = false;
+    p.advice = VM_ADVISE_NORMAL;
+
+    //PF delayed to vm_fault
+
+    proc->pages.insert(proc->pages.end(), count, p);
+    if (proc->state_slot != NO_SLOT) {
+        memset(state.records(proc->state_slot) + proc->top_valid_index + 1, 0,
+                count * sizeof(uint32_t));
+        state.slot(proc->state_slot).pages = proc->top_valid_index + 1 + count;
+    }
+    proc->top_valid_index += count;
+}
+
+/*
+ * vm_extend
+ *
+ * A request by current process to declare as valid the lowest invalid virtual
+ * page in the arena.  It should return the lowest-numbered byte of the new
+ * valid virtual page.  E.g., if the valid part of the arena before calling
+ * vm_extend is 0x60000000-0x60003fff, the return value will be 0x60004000,
+ * and the resulting valid part of the arena will be 0x60000000-0x60005fff.
+ * vm_extend should return NULL on error, e.g., if the disk is out of swap
+ * space.
+ */
+void * vm_extend() {
+    pager_guard guard(current_process);
+
+    //If top valid index is exceeds the bounds of the arena, return NULL
+    if ((current_process->top_valid_index+1) >= VM_ARENA_SIZE / VM_PAGESIZE)
+        return NULL;
+    //If the swap reservation would exceed the limit, return NULL
+    if (!reserve_swap(1))
+        return NULL;
+
+    append_pages(current_process, 1, false);
+
+    return (void *) ((unsigned long long) VM_ARENA_BASEADDR + current_process->top_valid_index * VM_PAGESIZE);
+}
+
+/*
+ * vm_extend_n
+ *
+ * A request by current process to declare as valid the lowest "count"
+ * invalid virtual pages in the arena, all or nothing: the swap reservation
+ * for all of them is checked and taken at once, and their vpages appended
+ * in one go.  Returns the lowest-numbered byte of the first new page, or
+ * NULL on error.
+ */
+void * vm_extend_n(unsigned int count) {
+    pager_guard guard(current_process);
+
+    unsigned int first = current_process->top_valid_index + 1;
+    if (count == 0 || count > VM_ARENA_SIZE / VM_PAGESIZE - first)
+        return NULL;
+    if (!reserve_swap(count))
+        return NULL;
+
+    append_pages(current_process, count, false);
+
+    return (void *) ((unsigned long long) VM_ARENA_BASEADDR + (unsigned long long) first * VM_PAGESIZE);
+}
+
+//pages written back together with an evicted page
+#define CLUSTER_PAGES 16
+
+bool by_block(const disk_iovec_t& a, const disk_iovec_t& b)
+{
+    return a.block < b.block;
+}
+
+//write back the dirty page in frame f together with the dirty pages that
+//follow it in its process, as long as they are resident, not all zeros and
+//revoked by the replacement engine, so they cannot change without a fault.
+//Pages without a disk block get one here, so a cluster written for the
+//first time usually lands on consecutive blocks and goes out in a single
+//request.  The pages written along with f stay resident, now clean, and
+//busy until the write is done.  f must already be busy.  Returns false if
+//f needs a disk block and none is free.
+bool write_cluster(unsigned int f)
+{
+    process_info* proc = core_map[f].proc;
+    unsigned int first = core_map[f].vpn;
+    disk_iovec_t vec[CLUSTER_PAGES];
+    unsigned int count = 0;
+
+    for (unsigned int vpn = first; count < CLUSTER_PAGES && (int) vpn <= proc->top_valid_index; vpn++) {
+        vpage& p = proc->pages[vpn];
+        page_table_entry_t& pte = proc->ptbl_ptr->ptes[vpn];
+        if (vpn != first && (!p.resident || pte.read_enable || pte.write_enable
+                || !needs_writeback(p) || p.busy || core_map[pte.ppage].more != NULL
+                || page_is_zero(frame_addr(pte.ppage))))
+            break;
+        if (p.disk_block == NO_BLOCK) {
+            if (!bind_block(proc, vpn))
+                break;
+        }
+        vec[count].block = p.disk_block;
+        vec[count].ppage = pte.ppage;
+        count++;
+    }
+    if (count == 0)
+        return false;
+
+    for (unsigned int vpn = first + 1; vpn < first + count; vpn++) {
+        proc->pages[vpn].dirty = false;
+        proc->pages[vpn].busy = true;
+    }
+    //(accesses through translations made before the engine revoked them
+    //finish first)
+    if (pager_locking) {
+        for (unsigned int i = 1; i < count; i++)
+            pm_shootdown(proc->ptbl_ptr->ptes[first + i].ppage);
+    }
+    sort(vec, vec + count, by_block);
+    drop_pager_lock();
+    uint64_t start = event_start();
+    disk_writev(vec, count);
+    log_event(EVENT_DISK_WRITE, count, proc->pid, vec[0].block, start);
+    take_pager_lock();
+    for (unsigned int vpn = first; vpn < first + count; vpn++)
+        save_page(proc, vpn, true);
+    for (unsigned int vpn = first + 1; vpn < first + count; vpn++)
+        end_io(proc, vpn);
+    count_event(proc, &pager_stats::fg_writebacks, count);
+    return true;
+}
+
+unsigned int zcache_slots_for(unsigned int length)
+{
+    return (length + ZCACHE_SLOT - 1) / ZCACHE_SLOT;
+}
+
+//free entry e of shard s's cache, which no page uses any more
+void zcache_release(pager_shard& s, unsigned int e)
+{
+    zentry& z = s.zcache[e];
+    for (unsigned int k = 0; k < zcache_slots_for(z.length); k++)
+        s.zcache_slots.release(z.slot + k);
+    s.zcache_fifo.erase(z.age);
+    s.zcache_stored -= z.length;
+    z.pages.clear();
+    s.zcache_unused.push_back(e);
+}
+
+//remove page vpn of proc from its cache entry, freeing the entry with its
+//last page
+void zcache_unmap(process_info* proc, unsigned int vpn)
+{
+    pager_shard& s = shard_of(proc);
+    unordered_map<page_key, unsigned int>::iterator i = s.zcache_index.find(make_page_key(proc->pid, vpn));
+    assert(i != s.zcache_index.end());
+    vector<mapping>& pages = s.zcache[i->second].pages;
+    for (size_t k = 0; k < pages.size(); k++) {
+        if (pages[k].proc == proc && pages[k].vpn == vpn) {
+            pages[k] = pages.back();
+            pages.pop_back();
+            break;
+        }
+    }
+    if (pages.empty())
+        zcache_release(s, i->second);
+    s.zcache_index.erase(i);
+    proc->pages[vpn].zcached = false;
+    s.zcache_pages--;
+}
+
+//write the oldest entry of shard s's cache to disk, decompressed into frame
+//f for the write, and free it.  Its pages get a disk block, shared between
+//them, and are busy until the write is done.  Returns false if the disk
+//is full.
+bool zcache_writeout(pager_shard& s, unsigned int f)
+{
+    unsigned int e = s.zcache_fifo.front();
+    mapping first = s.zcache[e].pages[0];
+    if (!bind_block(first.proc, first.vpn))
+        return false;
+    unsigned int block = first.page().disk_block;
+    bool ok = lz_decompress(s.zcache_base + (size_t) s.zcache[e].slot * ZCACHE_SLOT,
+            s.zcache[e].length, frame_addr(f));
+    assert(ok);
+    (void) ok;
+
+    vector<mapping> pages;
+    pages.swap(s.zcache[e].pages);
+    zcache_release(s, e);
+    for (size_t k = 0; k < pages.size(); k++) {
+        vpage& p = pages[k].page();
+        if (k > 0) {
+            p.disk_block = block;
+            share_block(block);
+        }
+        p.zcached = false;
+        p.busy = true;
+        s.zcache_index.erase(make_page_key(pages[k].proc->pid, pages[k].vpn));
+    }
+    s.zcache_pages -= pages.size();
+
+    drop_pager_lock();
+    uint64_t start = event_start();
+    disk_write(block, f);
+    log_event(EVENT_DISK_WRITE, 1, first.proc->pid, block, start);
+    take_pager_lock();
+    for (size_t k = 0; k < pages.size(); k++) {
+        save_page(pages[k].proc, pages[k].vpn, false);
+        end_io(pages[k].proc, pages[k].vpn);
+    }
+    count_event(first.proc, &pager_stats::zcache_writebacks);
+    return true;
+}
+
+//evict the dirty page in frame f, which no other page shares, into its
+//shard's cache instead of to disk: it is compressed with the shard's lock
+//dropped, and the oldest entries are written out until there is room for
+//it, using f as their buffer since its page is in zcache_buffer by then.
+//Returns false, with the page back in f, if it does not compress enough
+//or no room can be made.
+bool zcache_store(unsigned int f)
+{
+    process_info* proc = core_map[f].proc;
+    unsigned int vpn = core_map[f].vpn;
+    pager_shard& s = shard_of(proc);
+    char* page = frame_addr(f);
+    drop_pager_lock();
+    unsigned int length = lz_compress(page, zcache_buffer, ZCACHE_MAX_BYTES);
+    take_pager_lock();
+    if (length == 0) {
+        count_event(proc, &pager_stats::zcache_rejects);
+        return false;
+    }
+
+    unsigned int slots = zcache_slots_for(length);
+    bool bounced = false;
+    while (s.zcache_slots.largest().second < slots) {
+        if (s.zcache_fifo.empty() || !zcache_writeout(s, f)) {
+            if (bounced)
+                lz_decompress(zcache_buffer, length, page);
+            count_event(proc, &pager_stats::zcache_rejects);
+            return false;
+        }
+        bounced = true;
+    }
+
+    unsigned int e;
+    if (s.zcache_unused.empty()) {
+        e = s.zcache.size();
+        s.zcache.push_back(zentry());
+    } else {
+        e = s.zcache_unused.back();
+        s.zcache_unused.pop_back();
+    }
+    zentry& z = s.zcache[e];
+    z.slot = s.zcache_slots.largest().first;
+    for (unsigned int k = 0; k < slots; k++)
+        s.zcache_slots.take(z.slot + k);
+    z.length = length;
+    memcpy(s.zcache_base + (size_t) z.slot * ZCACHE_SLOT, zcache_buffer, length);
+    mapping m = {proc, vpn};
+    z.pages.push_back(m);
+    z.age = s.zcache_fifo.insert(s.zcache_fifo.end(), e);
+    s.zcache_index[make_page_key(proc->pid, vpn)] = e;
+    s.zcache_pages++;
+    s.zcache_stored += length;
+
+    //the page's disk copy, if any, is stale
+    vpage& p = proc->pages[vpn];
+    if (p.disk_block != NO_BLOCK) {
+        release_block(p.disk_block);
+        p.disk_block = NO_BLOCK;
+        save_page(proc, vpn, false);
+    }
+    p.zcached = true;
+    count_event(proc, &pager_stats::zcache_stores);
+    count_event(proc, &pager_stats::zcache_bytes, length);
+    return true;
+}
+
+//decompress page vpn of the current process from the cache into the frame
+//already set in its page table entry.  The cache held its only copy, so
+//the page is dirty.
+void zcache_load(unsigned int vpn)
+{
+    process_info* proc = current_process;
+    pager_shard& s = shard_of(proc);
+    unsigned int e = s.zcache_index[make_page_key(proc->pid, vpn)];
+    bool ok = lz_decompress(s.zcache_base + (size_t) s.zcache[e].slot * ZCACHE_SLOT,
+            s.zcache[e].length, frame_addr(proc->ptbl_ptr->ptes[vpn].ppage));
+    assert(ok);
+    (void) ok;
+    zcache_unmap(proc, vpn);
+    proc->pages[vpn].dirty = true;
+    count_event(proc, &pager_stats::zcache_hits);
+}
+
+zcache_usage pager_zcache_usage()
+{
+    pager_guard guard;
+    zcache_usage u;
+    u.frames = pager_zcache_frames;
+    u.pages = 0;
+    u.bytes = 0;
+    u.free_bytes = 0;
+    for (unsigned int k = 0; k < pager_shards; k++) {
+        u.pages += shards[k]->zcache_pages;
+        u.bytes += shards[k]->zcache_stored;
+        u.free_bytes += (unsigned long long) shards[k]->zcache_slots.free_blocks() * ZCACHE_SLOT;
+    }
+    return u;
+}
+
+//the next resident page of proc from its rss_hand whose reference bit is
+//clear, clearing the bits of those passed (a second chance); FRAME_NIL if
+//all of its resident pages are busy
+unsigned int own_victim(process_info* proc)
+{
+    unsigned int pages = proc->top_valid_index + 1;
+    for (unsigned int n = 0; n < 2 * pages; n++) {
+        unsigned int vpn = proc->rss_hand;
+        if (++proc->rss_hand >= pages)
+            proc->rss_hand = 0;
+        vpage& p = proc->pages[vpn];
+        if (!p.resident || p.busy)
+            continue;
+        unsigned int f = proc->ptbl_ptr->ptes[vpn].ppage;
+        if (core_map[f].proc != proc)
+            continue;
+        if (!p.reference)
+            return f;
+        clear_reference(f);
+    }
+    return FRAME_NIL;
+}
+
+//the frames the engine's victim passes over (see choose_victim), at most
+//once round the engine's frames
+struct spared_frames {
+    pager_shard* shard;
+    unsigned int left;
+
+    bool operator()(unsigned int f)
+    {
+        if (left == 0)
+            return false;
+        const frame& fr = core_map[f];
+        bool spare = fr.page().busy
+                || (shard->reclaimable > 0 && fr.proc->rss <= fr.proc->rss_min);
+        if (spare)
+            left--;
+        return spare;
+    }
+};
+
+//take the frame to evict out of the engine: one of own's pages if own is
+//given, else the engine's victim, passing over the frames being written
+//back and those of processes within their guaranteed resident set while
+//others hold frames beyond theirs.  The frames passed over keep their
+//place and history in the engine.
+template <class Policy>
+unsigned int choose_victim(policy_shard<Policy>& shard, process_info* own)
+{
+    if (own != NULL) {
+        unsigned int f = own_victim(own);
+        if (f != FRAME_NIL)
+            shard.engine.remove(f);
+        return f;
+    }
+    spared_frames spare = {&shard, shard.engine_frames - 1};
+    return shard.engine.victim(spare);
+}
+
+//evict the engine's victim, or one of own's pages if own is given (see
+//choose_victim), writing it back with its cluster (see write_cluster) if
+//it is dirty, or into the compressed swap cache if there is one and it
+//compresses (see zcache_store).  A victim another thread is writing back
+//is reinstated in the engine where victim() took it from, and evict
+//returns true once the write is done, without evicting anything: the
+//caller looks for a free frame again.  A dirty page that is all zeros is
+//not written back at all: it is refilled with zeros when it faults again.
+//Returns false, leaving the victim resident and reinstated, if it needs a
+//block and the disk is full, which only an overcommitted swap reservation
+//allows.  The cleaner thread, if running, is woken when clean frames run
+//low.
+template <class Policy>
+bool evict(policy_shard<Policy>& shard, process_info* own = NULL)
+{
+    uint64_t start = event_start();
+    unsigned int f = choose_victim(shard, own);
+    if (f == FRAME_NIL) {
+        if (!pager_locking)
+            return false;
+        wait_on(shard);
+        return true;
+    }
+    process_info* proc = core_map[f].proc;
+    unsigned int vpn = core_map[f].vpn;
+    if (proc->pages[vpn].busy) {
+        shard.engine.reinstate(f);
+        wait_on(shard);
+        log_event(EVENT_EVICT, EVICT_BUSY, proc->pid, vpn, start);
+        return true;
+    }
+    shard.engine_frames--;
+    vpage& temp = proc->pages[vpn];
+    temp.busy = true;
+    //(the windows onto a segment's page are pages of processes of other
+    //shards: only their mappings are touched)
+    vector<mapping>* more = core_map[f].more;
+    if (more != NULL && !proc->segment) {
+        for (size_t i = 0; i < more->size(); i++)
+            (*more)[i].page().busy = true;
+    }
+    //no access reaches the frame from here on, nor is one left in flight,
+    //so its contents cannot change under the write-back
+    if (pager_locking) {
+        revoke_frame(f);
+        pm_shootdown(f);
+    }
+    uint8_t path = EVICT_CLEAN;
+
+    assert(temp.valid && temp.resident && core_map[f].pte().ppage == f);
+    if(temp.dirty == true && temp.written_to == true)
+    {
+        if (page_is_zero(frame_addr(f))) {
+            //all zeros again: drop the disk copy, the next fault zero-fills
+            if (temp.disk_block != NO_BLOCK) {
+                release_block(temp.disk_block);
+                temp.disk_block = NO_BLOCK;
+            }
+            temp.written_to = false;
+            count_event(proc, &pager_stats::zero_pages);
+            path = EVICT_ZERO;
+        } else if (pager_zcache_frames > 0 && more == NULL && zcache_store(f)) {
+            path = EVICT_COMPRESSED;
+        } else if (!write_cluster(f)) {
+            shard.engine.reinstate(f);
+            shard.engine_frames++;
+            end_io(proc, vpn);
+            if (more != NULL && !proc->segment) {
+                for (size_t i = 0; i < more->size(); i++)
+                    end_io((*more)[i].proc, (*more)[i].vpn);
+            }
+            log_event(EVENT_EVICT, EVICT_FULL, proc->pid, vpn, start);
+            return false;
+        } else {
+            path = EVICT_DIRTY;
+        }
+    }
+
+    //the write may have let the process grow, moving its pages
+    vpage& p = proc->pages[vpn];
+    page_table_entry_t& pte = proc->ptbl_ptr->ptes[vpn];
+
+    //a page read ahead and never used: read less ahead of its process
+    if (p.readahead) {
+        p.readahead = false;
+        proc->ra_window = max((unsigned int) RA_MIN_PAGES, proc->ra_window / 2);
+    }
+
+    //make page non-resident
+    pte.read_enable=0;
+    pte.write_enable=0;
+    p.resident=false;
+    save_page(proc, vpn, false);
+    end_io(proc, vpn);
 
-struct process_info {
-    page_table_t* ptbl_ptr;
-    page** pages;
-    int top_valid_index;
-};
+    //the other pages of a frame shared copy-on-write share its disk copy
+    //too; windows onto a segment's page just lose their mapping
+    if (more != NULL) {
+        for (size_t i = 0; i < more->size(); i++) {
+            (*more)[i].pte().read_enable = 0;
+            (*more)[i].pte().write_enable = 0;
+            if (proc->segment)
+                continue;
+            vpage& q = (*more)[i].page();
+            if (q.disk_block != NO_BLOCK)
+                release_block(q.disk_block);
+            q.disk_block = p.disk_block;
+            if (p.disk_block != NO_BLOCK)
+                share_block(p.disk_block);
+            q.written_to = p.written_to;
+            save_page((*more)[i].proc, (*more)[i].vpn, false);
+            q.readahead = false;
+            q.resident = false;
+            end_io((*more)[i].proc, (*more)[i].vpn);
+        }
+        delete more;
+        core_map[f].more = NULL;
+    }
 
-pid_t current_id;
-process_info* current_process;
+    // add it back to the free pages
+    core_map[f].proc = NULL;
+    free_frame(shard, f);
+    charge_frame(proc, -1);
+    count_event(proc, &pager_stats::evictions);
+    if (own != NULL)
+        count_event(proc, &pager_stats::limit_evictions);
+    if (shard.clean_reserve > 0)
+        shard.clean_reserve--;
+    if (cleaner_running && shard.clean_reserve < shard.clean_low)
+        wake_cleaner();
+    log_event(EVENT_EVICT, path, proc->pid, vpn, start);
+    return true;
+}
 
-typedef map<pid_t, process_info*>::const_iterator process_iter;
-map<pid_t, process_info*> process_map;
+//take a free frame into f for the current process, evicting pages until
+//one is free.  If every frame is being filled by other faults there is
+//nothing to evict: wait for one of them to finish if "wait" is set, else
+//give up.  A process at its resident set limit first evicts one of its own
+//pages, or gives up if "wait" is not set.  Returns false if no frame could
+//be had.
+template <class Policy>
+bool alloc_frame(policy_shard<Policy>& shard, unsigned int& f, bool wait = true)
+{
+    process_info* proc = current_process;
+    while (proc->rss_max != 0 && proc->rss >= proc->rss_max) {
+        if (!wait || !evict(shard, proc))
+            return false;
+    }
+    while (shard.free_pages.empty()) {
+        if (shard.engine_frames == 0) {
+            if (!wait || !pager_locking)
+                return false;
+            wait_on(shard);
+        } else if (!evict(shard)) {
+            return false;
+        }
+    }
+    f = take_frame(shard);
+    charge_frame(proc, 1);
+    return true;
+}
 
-queue<page*> clock_q;
+//record page vpn of the current process as resident in its frame and hand
+//the frame to the engine, waking faults that wait for a frame to evict
+template <class Policy>
+void map_frame(policy_shard<Policy>& shard, unsigned int vpn)
+{
+    unsigned int ppage = current_process->ptbl_ptr->ptes[vpn].ppage;
+    core_map[ppage].proc = current_process;
+    core_map[ppage].vpn = vpn;
+    save_page(current_process, vpn, true);
+    shard.engine.insert(ppage);
+    shard.engine_frames++;
+    wake_waiters(shard);
+}
 
-unsigned int num_pages;
-unsigned int num_blocks;
-/*
- * vm_init
- *
- * Called when the pager starts.  It should set up any internal data structures
- * needed by the pager, e.g. physical page bookkeeping, process table, disk
- * usage table, etc.
- *
- * vm_init is passed both the number of physical memory pages and the number
- * of disk blocks in the raw disk.
- */
-void vm_init(unsigned int memory_pages, unsigned int disk_blocks) {
-    //Init all free physical pages
-    for (unsigned int i = 0; i <memory_pages; i++) {
-        free_pages.push(i);
+//record page vpn of the current process, just read in ahead of its use,
+//as resident: it enters the replacement engine unreferenced and with
+//access revoked, so its first access is a minor fault that grows the
+//read-ahead window, while its eviction unused shrinks it
+template <class Policy>
+void map_ahead(policy_shard<Policy>& shard, unsigned int vpn)
+{
+    vpage& p = current_process->pages[vpn];
+    page_table_entry_t& pte = current_process->ptbl_ptr->ptes[vpn];
+    pte.read_enable = 0;
+    pte.write_enable = 0;
+    p.resident = true;
+    p.reference = false;
+    p.readahead = true;
+    map_frame(shard, vpn);
+}
+
+//read page vpn of the current process from disk into the frame already
+//set in its page table entry.  If the faults that read pages from disk
+//follow a constant stride, the next ra_window pages of the stride that are
+//on disk are read too, in the same disk_readv (see map_ahead).  A page
+//advised sequential reads the most ahead at stride 1 from its first fault,
+//and a page advised random reads nothing ahead, nor is read ahead.
+template <class Policy>
+void page_in(policy_shard<Policy>& shard, unsigned int vpn)
+{
+    process_info* proc = current_process;
+    disk_iovec_t vec[1 + RA_MAX_PAGES];
+    unsigned int vpns[1 + RA_MAX_PAGES];
+    unsigned int count = 0;
+
+    vec[count].block = proc->pages[vpn].disk_block;
+    vec[count].ppage = proc->ptbl_ptr->ptes[vpn].ppage;
+    vpns[count++] = vpn;
+    count_event(proc, &pager_stats::major_faults);
+
+    int stride = (int) vpn - (int) proc->ra_last;
+    proc->ra_last = vpn;
+    unsigned int advice = proc->pages[vpn].advice;
+    if (advice == VM_ADVISE_SEQUENTIAL)
+        stride = 1;
+    if (stride != 0 && (stride == proc->ra_stride || advice == VM_ADVISE_SEQUENTIAL)
+            && advice != VM_ADVISE_RANDOM) {
+        //read-ahead may evict, so it only gets a small share of memory, and
+        //none below 8 pages
+        unsigned int window = advice == VM_ADVISE_SEQUENTIAL ? RA_MAX_PAGES : proc->ra_window;
+        window = min(window, shard.frames / 8);
+        long long next = vpn;
+        for (unsigned int k = 0; k < window; k++) {
+            next += stride;
+            if (next < 0 || next > proc->top_valid_index)
+                break;
+            vpage& p = proc->pages[next];
+            if (!p.resident && (!p.written_to || p.disk_block == NO_BLOCK))
+                break;
+            if (p.advice == VM_ADVISE_RANDOM)
+                break;
+            proc->ra_last = next;
+            if (p.resident)
+                continue;
+            //a page being written back out of the compressed cache has a
+            //block whose contents are not there yet, and a page in the
+            //cache has newer contents than its block
+            if (p.busy || p.zcached)
+                break;
+            //(the frames of this read are held; waiting for others could
+            //deadlock with faults doing the same)
+            unsigned int f;
+            if (!alloc_frame(shard, f, false))
+                break;
+            //(finding the frame may have written the page out of the cache)
+            if (p.busy) {
+                free_frame(shard, f);
+                charge_frame(proc, -1);
+                wake_waiters(shard);
+                break;
+            }
+            proc->ptbl_ptr->ptes[next].ppage = f;
+            vec[count].block = p.disk_block;
+            vec[count].ppage = proc->ptbl_ptr->ptes[next].ppage;
+            vpns[count++] = next;
+        }
     }
-    //init all free disk_blocks
-    for (unsigned int i = 0; i <disk_blocks; i++) {
-        free_disk_blocks.push(i);
+    proc->ra_stride = stride;
+
+    sort(vec, vec + count, by_block);
+    drop_pager_lock();
+    uint64_t start = event_start();
+    disk_readv(vec, count);
+    log_event(EVENT_DISK_READ, count, proc->pid, vec[0].block, start);
+    take_pager_lock();
+    count_event(proc, &pager_stats::readahead_pages, count - 1);
+
+    for (unsigned int i = 1; i < count; i++) {
+        proc->pages[vpns[i]].dirty = false;
+        map_ahead(shard, vpns[i]);
     }
+}
 
-    page_table_base_register = NULL;
+//remove page vpn of proc from the pages sharing frame f.  If it was the
+//primary mapping, another page takes its place, with the reference bit and
+//the frame's charge.
+void unmap_shared(unsigned int f, process_info* proc, unsigned int vpn)
+{
+    frame& fr = core_map[f];
+    vector<mapping>& more = *fr.more;
+    if (fr.proc == proc && fr.vpn == vpn) {
+        mapping m = more.back();
+        more.pop_back();
+        m.page().reference = fr.page().reference;
+        charge_frame(proc, -1);
+        charge_frame(m.proc, 1);
+        fr.proc = m.proc;
+        fr.vpn = m.vpn;
+    } else {
+        for (size_t i = 0; i < more.size(); i++) {
+            if (more[i].proc == proc && more[i].vpn == vpn) {
+                more[i] = more.back();
+                more.pop_back();
+                break;
+            }
+        }
+    }
+    if (more.empty()) {
+        delete fr.more;
+        fr.more = NULL;
+    }
+}
 
-    num_pages=memory_pages;
-    num_blocks=disk_blocks;
+//give page vpn of the current process, resident in a shared frame, a frame
+//of its own holding a copy.  If the shared frame was evicted, or is no
+//longer shared, by the time a frame is found, the page is left as it is.
+//Returns false if no frame could be had.
+template <class Policy>
+bool copy_on_write(policy_shard<Policy>& shard, unsigned int vpn)
+{
+    unsigned int f;
+    if (!alloc_frame(shard, f))
+        return false;
+    wait_for_io(current_process, vpn);
+    vpage& p = current_process->pages[vpn];
+    page_table_entry_t& pte = current_process->ptbl_ptr->ptes[vpn];
+    if (!p.resident || !cow_shared(pte.ppage)) {
+        free_frame(shard, f);
+        charge_frame(current_process, -1);
+        wake_waiters(shard);
+        return true;
+    }
+
+    unsigned int shared = pte.ppage;
+    memcpy(frame_addr(f), frame_addr(shared), VM_PAGESIZE);
+    unmap_shared(shared, current_process, vpn);
+    pte.ppage = f;
+    map_frame(shard, vpn);
+    count_event(current_process, &pager_stats::cow_copies);
+    return true;
 }
 
-/*
- * vm_create
- *
- * Called when a new process, with process identifier "pid", is added to the
- * system.  It should create whatever new elements are required for each of
- * your data structures.  The new process will only run when it's switched
- * to via vm_switch().
- */
-void vm_create(pid_t pid) {
-    process_info* process = new process_info;
-    //create page table
-    process->ptbl_ptr = new page_table_t;
-    process->pages = new page*[VM_ARENA_SIZE / VM_PAGESIZE];
-    //initially no pte in page table is valid
-    process->top_valid_index = -1;
+//the pages of the current process overlapping the "len" bytes at "addr",
+//or only those lying wholly in them if "whole" is set, as [first, end).
+//Returns false if the range is empty or leaves the valid part of the arena.
+bool arena_range(void* addr, unsigned int len, bool whole, unsigned int& first, unsigned int& end)
+{
+    unsigned long long offset = (unsigned long long) addr - (unsigned long long) VM_ARENA_BASEADDR;
+    unsigned long long size = (unsigned long long) (current_process->top_valid_index + 1) * VM_PAGESIZE;
+    if (len == 0 || offset >= size || len > size - offset)
+        return false;
+    if (whole) {
+        first = (offset + VM_PAGESIZE - 1) / VM_PAGESIZE;
+        end = (offset + len) / VM_PAGESIZE;
+    } else {
+        first = offset / VM_PAGESIZE;
+        end = (offset + len - 1) / VM_PAGESIZE + 1;
+    }
+    return true;
+}
 
-    process_map[pid]= process;
+//discard pages first..end-1 of the current process (see vm_release): they
+//keep their swap reservation and read as zeros, like pages never written
+template <class Policy>
+void release(policy_shard<Policy>& shard, unsigned int first, unsigned int end)
+{
+    process_info* proc = current_process;
+    for (unsigned int vpn = first; vpn < end; vpn++) {
+        wait_for_io(proc, vpn);
+        vpage& p = proc->pages[vpn];
+        page_table_entry_t& pte = proc->ptbl_ptr->ptes[vpn];
+        if (p.shm)
+            continue;
+        if (p.resident && core_map[pte.ppage].more != NULL) {
+            unmap_shared(pte.ppage, proc, vpn);
+        } else if (p.resident) {
+            //(no access may land in the frame once it is free)
+            if (pager_locking) {
+                revoke_frame(pte.ppage);
+                pm_shootdown(pte.ppage);
+            }
+            shard.engine.remove(pte.ppage);
+            shard.engine_frames--;
+            core_map[pte.ppage].proc = NULL;
+            free_frame(shard, pte.ppage);
+            charge_frame(proc, -1);
+        } else {
+            shard.engine.forget(make_page_key(proc->pid, vpn));
+            if (p.zcached)
+                zcache_unmap(proc, vpn);
+        }
+        if (p.disk_block != NO_BLOCK) {
+            release_block(p.disk_block);
+            p.disk_block = NO_BLOCK;
+        }
+        pte.read_enable = 0;
+        pte.write_enable = 0;
+        p.resident = false;
+        p.reference = false;
+        p.readahead = false;
+        p.dirty = false;
+        p.written_to = false;
+        save_page(proc, vpn, false);
+        count_event(proc, &pager_stats::released_pages);
+    }
+    //faults may be waiting for the frames
+    wake_waiters(shard);
 }
 
-/*
- * vm_switch
- *
- * Called when the kernel is switching to a new process, with process
- * identifier "pid".  This allows the pager to do any bookkeeping needed to
- * register the new process.
- */
-void vm_switch(pid_t pid) {
-    process_iter i = process_map.find(pid);
-    if (i != process_map.end()) {
-        current_id = pid;
-        current_process = (*i).second;
-        page_table_base_register = current_process->ptbl_ptr;
+//read the pages first..end-1 of the current process that have contents
+//elsewhere in ahead of their use (see map_ahead), in batches of up to
+//RA_MAX_PAGES pages, decompressing those in the compressed swap cache.
+//Like read-ahead, it takes no more than a quarter of memory, and stops
+//rather than wait for a frame.
+template <class Policy>
+void prefetch(policy_shard<Policy>& shard, unsigned int first, unsigned int end)
+{
+    process_info* proc = current_process;
+    disk_iovec_t vec[RA_MAX_PAGES];
+    unsigned int vpns[RA_MAX_PAGES];
+    unsigned int budget = shard.frames / 4;
+    unsigned int vpn = first;
+    while (vpn < end && budget > 0) {
+        unsigned int count = 0;
+        for (; vpn < end && count < RA_MAX_PAGES && budget > 0; vpn++) {
+            vpage& p = proc->pages[vpn];
+            if (p.shm || p.resident || p.busy || !p.written_to)
+                continue;
+            unsigned int f;
+            if (!alloc_frame(shard, f, false)) {
+                budget = 0;
+                break;
+            }
+            budget--;
+            //(finding the frame may have written the page out of the
+            //compressed cache)
+            wait_for_io(proc, vpn);
+            proc->ptbl_ptr->ptes[vpn].ppage = f;
+            if (proc->pages[vpn].zcached) {
+                zcache_load(vpn);
+                map_ahead(shard, vpn);
+                count_event(proc, &pager_stats::readahead_pages);
+            } else {
+                vec[count].block = proc->pages[vpn].disk_block;
+                vec[count].ppage = f;
+                vpns[count++] = vpn;
+            }
+        }
+        if (count == 0)
+            continue;
+
+        sort(vec, vec + count, by_block);
+        drop_pager_lock();
+        uint64_t start = event_start();
+        disk_readv(vec, count);
+        log_event(EVENT_DISK_READ, count, proc->pid, vec[0].block, start);
+        take_pager_lock();
+        count_event(proc, &pager_stats::readahead_pages, count);
+        for (unsigned int i = 0; i < count; i++) {
+            proc->pages[vpns[i]].dirty = false;
+            map_ahead(shard, vpns[i]);
+        }
     }
 }
 
-/*
- * vm_extend
- *
- * A request by current process to declare as valid the lowest invalid virtual
- * page in the arena.  It should return the lowest-numbered byte of the new
- * valid virtual page.  E.g., if the valid part of the arena before calling
- * vm_extend is 0x60000000-0x60003fff, the return value will be 0x60004000,
- * and the resulting valid part of the arena will be 0x60000000-0x60005fff.
- * vm_extend should return NULL on error, e.g., if the disk is out of swap
- * space.
- */
-void * vm_extend() {
+//make the resident pages first..end-1 of the current process the engine's
+//next candidates for eviction, by clearing their reference bits.  Pages
+//sharing a frame with another process's are left to it.
+void deactivate(unsigned int first, unsigned int end)
+{
+    process_info* proc = current_process;
+    for (unsigned int vpn = first; vpn < end; vpn++) {
+        vpage& p = proc->pages[vpn];
+        if (!p.resident || p.busy || !p.reference || p.shm)
+            continue;
+        unsigned int f = proc->ptbl_ptr->ptes[vpn].ppage;
+        if (core_map[f].proc == proc && core_map[f].vpn == vpn)
+            clear_reference(f);
+    }
+}
 
-    //If top valid index is exceeds the bounds of the arena, return NULL
-    if ((current_process->top_valid_index+1) >= VM_ARENA_SIZE / VM_PAGESIZE)
-        return NULL;
-    //If there are no free disk blocks, return NULL (Eager allocation)
-    if (free_disk_blocks.empty())
-        return NULL;
+//resume the processes of the state file (see pager_state).  Their blocks
+//are taken from the free ones, or shared if another page holds them too;
+//records naming no block of this disk are dropped.
+void restore_processes()
+{
+    state_header& h = state.header();
+    for (unsigned int i = 0; i < h.slots; i++) {
+        state_slot& s = state.slot(i);
+        if (!s.live)
+            continue;
+        if (s.pages > VM_ARENA_SIZE / VM_PAGESIZE || process_map.find(s.pid) != NULL) {
+            cerr << "error: state file " << pager_state << " has a bad slot " << i << endl;
+            exit(1);
+        }
+        process_info* proc = new_process(s.pid);
+        proc->swap_base = s.swap_base;
+        append_pages(proc, s.pages, false);
+        proc->state_slot = i;
+        uint32_t* records = state.records(i);
+        for (unsigned int vpn = 0; vpn < s.pages; vpn++) {
+            uint32_t r = records[vpn];
+            unsigned int block = (r & ~STATE_RESIDENT) - 1;
+            if ((r & ~STATE_RESIDENT) == STATE_NONE || block >= num_blocks) {
+                records[vpn] = STATE_NONE;
+                continue;
+            }
+            if (!take_block(block))
+                share_block(block);
+            proc->pages[vpn].disk_block = block;
+            proc->pages[vpn].written_to = true;
+            restored.pages++;
+            if (r & STATE_RESIDENT) {
+                records[vpn] = r & ~STATE_RESIDENT;
+                warm_list.push_back(make_pair(s.pid, vpn));
+            }
+        }
+        pager_swap_reserved += s.pages;
+        process_map.insert(s.pid, proc);
+        restored.processes++;
+    }
+    h.restarts++;
+}
 
-    current_process->top_valid_index++;
+//read the pages of warm_list back in (see prefetch), a run of consecutive
+//pages of a process at a time, until a sixteenth of the frames of the
+//process's shard is left free, so that the first faults after it need not
+//evict.  The process is looked up with every shard locked, and its lock
+//cannot be waited for with them held, so a process in the middle of a call
+//is polled until it is out; holding its lock keeps it alive once the
+//shards are let go.
+template <class Policy>
+void warm()
+{
+    //(runs as long as prefetch reads at once)
+    size_t run = max(1U, min((unsigned int) RA_MAX_PAGES, shard_frames / 4));
+    size_t i = 0;
+    while (i < warm_list.size()) {
+        size_t j = i + 1;
+        while (j < warm_list.size() && j - i < run
+                && warm_list[j].first == warm_list[i].first
+                && warm_list[j].second == warm_list[j - 1].second + 1)
+            j++;
+        lock_all();
+        process_info* proc = process_map.find(warm_list[i].first);
+        bool locked = proc != NULL && pthread_mutex_trylock(&proc->lock) == 0;
+        unlock_all();
+        if (proc != NULL && !locked) {
+            usleep(1000);
+            continue;
+        }
+        if (proc != NULL) {
+            policy_shard<Policy>& shard = shard_at<Policy>(proc->shard);
+            lock_shard(shard);
+            unsigned int reserve = shard.frames / 16;
+            if (shard.free_pages.count() > reserve) {
+                current_process = proc;
+                current_id = proc->pid;
+                unsigned int first = warm_list[i].second;
+                unsigned int end = min(warm_list[j - 1].second + 1, (unsigned int) (proc->top_valid_index + 1));
+                end = min(end, first + shard.free_pages.count() - reserve);
+                unsigned long long read = proc->stats.readahead_pages;
+                if (first < end)
+                    prefetch(shard, first, end);
+                restored.warm_pages += proc->stats.readahead_pages - read;
+                current_process = NULL;
+            }
+            unlock_shard();
+            pthread_mutex_unlock(&proc->lock);
+        }
+        i = j;
+    }
+    lock_all();
+    restored.warming = false;
+    unlock_all();
+}
+
+void* warmer(void*)
+{
+    switch (policy) {
+    case WSCLOCK:
+        warm<wsclock_policy>();
+        break;
+    case CLOCKPRO:
+        warm<clockpro_policy>();
+        break;
+    case ARC:
+        warm<arc_policy>();
+        break;
+    case LRUK:
+        warm<lruk_policy>();
+        break;
+    default:
+        warm<clock_policy>();
+        break;
+    }
+    return NULL;
+}
 
-    page* p = new page;
+restore_usage pager_restore_usage()
+{
+    pager_guard guard;
+    return restored;
+}
 
-    //init virtual pages
-    p->pte_ptr = &(page_table_base_register->ptes[current_process->top_valid_index]);
+//write the compressed swap cache and the dirty pages of processes with a
+//slot to disk (see pager_checkpoint), with every shard locked.  A shard's
+//cache is written out through a frame of its own, evicting a page for it
+//if none is free.  Frames shared copy-on-write are left to eviction, which
+//gives all their pages a block.
+template <class Policy>
+bool checkpoint()
+{
+    for (unsigned int k = 0; k < pager_shards; k++) {
+        policy_shard<Policy>& shard = shard_at<Policy>(k);
+        if (shard.zcache_fifo.empty())
+            continue;
+        while (shard.free_pages.empty()) {
+            if (shard.engine_frames == 0 || !evict(shard))
+                return false;
+        }
+        unsigned int f = take_frame(shard);
+        bool written = true;
+        for (size_t n = shard.zcache_fifo.size(); n > 0 && written && !shard.zcache_fifo.empty(); n--)
+            written = zcache_writeout(shard, f);
+        free_frame(shard, f);
+        wake_waiters(shard);
+        if (!written)
+            return false;
+    }
+    for (unsigned int f = 0; f < num_pages; f++) {
+        frame& fr = core_map[f];
+        if (fr.proc == NULL || fr.proc->state_slot == NO_SLOT || fr.more != NULL
+                || fr.page().busy || !needs_writeback(fr.page()))
+            continue;
+        //(a write to the page now faults, and waits for the write-back)
+        fr.pte().write_enable = 0;
+        if (!clean_frame(f))
+            return false;
+    }
+    return state.sync();
+}
 
-    //allocate disk_block
-    p->disk_block = free_disk_blocks.top();
-    free_disk_blocks.pop();
+bool pager_checkpoint()
+{
+    if (!state.mapped())
+        return false;
+    pager_guard guard;
+    switch (policy) {
+    case WSCLOCK:
+        return checkpoint<wsclock_policy>();
+    case CLOCKPRO:
+        return checkpoint<clockpro_policy>();
+    case ARC:
+        return checkpoint<arc_policy>();
+    case LRUK:
+        return checkpoint<lruk_policy>();
+    default:
+        return checkpoint<clock_policy>();
+    }
+}
 
-    //make non-resident
-    p->pte_ptr->read_enable = 0;
-    p->pte_ptr->write_enable = 0;
+//dedup scanner state: the hash of each frame's page when the scanner last
+//saw it (allocated by the first scan), and the scanner's hand and work.
+//Scans are serialised on dedup_lock, taken before any shard's lock, and
+//merge pages of one shard only (see pager_shard's dedup_index).
+struct dedup_sum {
+    page_key key;
+    uint64_t hash;
+};
 
-    p->reference = false;
-    p->resident = false;
-    p->written_to = false;
-    p->valid = true;
-    p->dirty = false;
+vector<dedup_sum> dedup_sums;
+unsigned int dedup_hand;
+unsigned long long dedup_scanned;
+pthread_mutex_t dedup_lock = PTHREAD_MUTEX_INITIALIZER;
 
-    //PF and disk block allocation delayed to vm_fault
+//revoke write access to frame f through every page mapping it, so that
+//its contents can only change through a fault.  The entries that could
+//write are added to "writable", if given, for unprotect_frames.
+void protect_frame(unsigned int f, vector<page_table_entry_t*>* writable = NULL)
+{
+    vector<mapping> all(1, core_map[f]);
+    if (core_map[f].more != NULL)
+        all.insert(all.end(), core_map[f].more->begin(), core_map[f].more->end());
+    for (size_t i = 0; i < all.size(); i++) {
+        page_table_entry_t& pte = all[i].pte();
+        if (pte.write_enable && writable != NULL)
+            writable->push_back(&pte);
+        pte.write_enable = 0;
+    }
+}
 
-    current_process->pages[current_process->top_valid_index] = p;
+//give back the write access protect_frame took
+void unprotect_frames(const vector<page_table_entry_t*>& writable)
+{
+    for (size_t i = 0; i < writable.size(); i++)
+        writable[i]->write_enable = 1;
+}
 
-    return (void *) ((unsigned long long) VM_ARENA_BASEADDR + current_process->top_valid_index * VM_PAGESIZE);
+//frame f holds a page the scanner may hash or merge: it is not free,
+//being read, written or evicted, read ahead and unused, or a segment's
+bool dedup_candidate(unsigned int f)
+{
+    const frame& fr = core_map[f];
+    return fr.proc != NULL && !fr.proc->segment && !fr.page().busy && !fr.page().readahead;
 }
 
-void evict()
+//move every page mapping frame f to frame g, which holds the same bytes,
+//and free f.  The pages are mapped read-only, and their access revoked
+//so that their next access maps g.  g's primary page stays its primary,
+//with the frame's charge; the other pages keep their own state, which
+//eviction replaces with the primary's (see evict).
+template <class Policy>
+void merge_frame(policy_shard<Policy>& shard, unsigned int f, unsigned int g)
 {
-    page* temp= clock_q.front();
+    frame& from = core_map[f];
+    frame& to = core_map[g];
+    protect_frame(g);
+    vector<mapping> moved(1, from);
+    if (from.more != NULL) {
+        moved.insert(moved.end(), from.more->begin(), from.more->end());
+        delete from.more;
+        from.more = NULL;
+    }
+    if (from.page().reference)
+        to.page().reference = true;
+    if (to.more == NULL)
+        to.more = new vector<mapping>;
+    for (size_t i = 0; i < moved.size(); i++) {
+        page_table_entry_t& pte = moved[i].pte();
+        pte.ppage = g;
+        pte.read_enable = 0;
+        pte.write_enable = 0;
+        to.more->push_back(moved[i]);
+        count_event(moved[i].proc, &pager_stats::merged_pages);
+    }
+    if (pager_locking)
+        pm_shootdown(f);
+
+    shard.engine.remove(f);
+    shard.engine_frames--;
+    charge_frame(from.proc, -1);
+    from.proc = NULL;
+    free_frame(shard, f);
+    wake_waiters(shard);
+}
 
-    assert(temp->valid);
-    while (temp->reference == true) {
-        temp->reference = false;
-        //reset read_enable so that the next read can be registered
-        temp->pte_ptr->read_enable = 0;
-        temp->pte_ptr->write_enable = 0;
+//hash the page in frame f.  If its hash has not changed since the scanner
+//last saw it, merge it into a frame of the shard's current pass with the
+//same hash and bytes, else make it the frame of the pass with that hash.
+//Pages are hashed as they are, writable: the hash only picks candidates.
+//Only a candidate pair is write-protected, while its bytes are compared,
+//and gets its write access back if they differ, so scanning a page that
+//is being written costs it no fault.  Returns true if f was merged.
+template <class Policy>
+bool dedup_frame(policy_shard<Policy>& shard, unsigned int f)
+{
+    if (!dedup_candidate(f))
+        return false;
+    const char* data = frame_addr(f);
+    if (page_is_zero(data))
+        return false;
+    uint64_t hash = page_hash(data);
+    dedup_sum& sum = dedup_sums[f];
+    bool stable = sum.key == core_map[f].key() && sum.hash == hash;
+    sum.key = core_map[f].key();
+    sum.hash = hash;
+    dedup_scanned++;
+    if (!stable)
+        return false;
 
-        clock_q.pop();
-        clock_q.push(temp);
-        temp=clock_q.front();
+    unordered_map<uint64_t, unsigned int>::iterator i = shard.dedup_index.find(hash);
+    if (i == shard.dedup_index.end()) {
+        shard.dedup_index[hash] = f;
+        return false;
+    }
+    unsigned int g = i->second;
+    if (g == f || !dedup_candidate(g) || dedup_sums[g].key != core_map[g].key()) {
+        i->second = f;
+        return false;
+    }
+    //(both pages are compared, and stay equal, only once no write made
+    //through an earlier translation is still landing)
+    vector<page_table_entry_t*> writable;
+    protect_frame(f, &writable);
+    protect_frame(g, &writable);
+    if (pager_locking) {
+        pm_shootdown(f);
+        pm_shootdown(g);
+    }
+    if (memcmp(data, frame_addr(g), VM_PAGESIZE) != 0) {
+        unprotect_frames(writable);
+        i->second = f;
+        return false;
+    }
+    merge_frame(shard, f, g);
+    return true;
+}
 
+//advance the scanner's hand over "frames" frames, holding the lock of the
+//shard under it, and letting faults in between chunks of the scan.  A new
+//pass over a shard forgets the frames of the last one.
+template <class Policy>
+unsigned int dedup_scan(unsigned int frames)
+{
+    if (dedup_sums.empty()) {
+        dedup_sum none = {~0ULL, 0};
+        dedup_sums.assign(num_pages, none);
     }
-    if(temp->dirty == true && temp->written_to == true)
-    {
-        disk_write(temp->disk_block,temp->pte_ptr->ppage);
+    unsigned int merged = 0;
+    pager_shard* locked = NULL;
+    for (unsigned int n = 0; n < frames; n++) {
+        unsigned int f = dedup_hand;
+        if (++dedup_hand == num_pages)
+            dedup_hand = 0;
+        policy_shard<Policy>& shard = shard_at<Policy>(min(f / shard_frames, pager_shards - 1));
+        if (locked != &shard || n % 64 == 0) {
+            if (locked != NULL)
+                unlock_shard();
+            lock_shard(shard);
+            locked = &shard;
+        }
+        if (f == shard.first)
+            shard.dedup_index.clear();
+        if (dedup_frame(shard, f))
+            merged++;
     }
+    if (locked != NULL)
+        unlock_shard();
+    return merged;
+}
 
-    //make page non-resident
-    temp->pte_ptr->read_enable=0;
-    temp->pte_ptr->write_enable=0;
-    temp->resident=false;
+unsigned int pager_dedup_scan(unsigned int frames)
+{
+    if (pager_locking)
+        pthread_mutex_lock(&dedup_lock);
+    unsigned int merged;
+    switch (policy) {
+    case WSCLOCK:
+        merged = dedup_scan<wsclock_policy>(frames);
+        break;
+    case CLOCKPRO:
+        merged = dedup_scan<clockpro_policy>(frames);
+        break;
+    case ARC:
+        merged = dedup_scan<arc_policy>(frames);
+        break;
+    case LRUK:
+        merged = dedup_scan<lruk_policy>(frames);
+        break;
+    default:
+        merged = dedup_scan<clock_policy>(frames);
+        break;
+    }
+    if (pager_locking)
+        pthread_mutex_unlock(&dedup_lock);
+    return merged;
+}
+
+void* dedup_scanner(void*)
+{
+    pthread_mutex_lock(&dedup_sleep_lock);
+    while (!dedup_stop) {
+        pthread_mutex_unlock(&dedup_sleep_lock);
+        pager_dedup_scan(pager_dedup_pages);
+        pthread_mutex_lock(&dedup_sleep_lock);
 
-    // add it back to the stack
-    free_pages.push(temp->pte_ptr->ppage);
-    clock_q.pop();
+        struct timespec until;
+        clock_gettime(CLOCK_REALTIME, &until);
+        unsigned long long ns = until.tv_nsec + pager_dedup_sleep_ms * 1000000ULL;
+        until.tv_sec += ns / 1000000000;
+        until.tv_nsec = ns % 1000000000;
+        while (!dedup_stop && pthread_cond_timedwait(&dedup_wake, &dedup_sleep_lock, &until) == 0)
+            ;
+    }
+    pthread_mutex_unlock(&dedup_sleep_lock);
+    return NULL;
 }
 
+void pager_shutdown()
+{
+    if (cleaner_running) {
+        pthread_mutex_lock(&cleaner_lock);
+        cleaner_stop = true;
+        pthread_cond_signal(&cleaner_wake);
+        pthread_mutex_unlock(&cleaner_lock);
+        pthread_join(cleaner_thread, NULL);
+        cleaner_running = false;
+    }
+    if (dedup_running) {
+        pthread_mutex_lock(&dedup_sleep_lock);
+        dedup_stop = true;
+        pthread_cond_signal(&dedup_wake);
+        pthread_mutex_unlock(&dedup_sleep_lock);
+        pthread_join(dedup_thread, NULL);
+        dedup_running = false;
+    }
+}
 
-void remove(page* p) {
-    page* rm=clock_q.front();
-    while (rm!=p) {
-        clock_q.pop();
-        clock_q.push(rm);
-        rm=clock_q.front();
+dedup_usage pager_dedup_usage()
+{
+    pager_guard guard;
+    dedup_usage u;
+    u.scanned = dedup_scanned;
+    u.merged = pager_totals.merged_pages;
+    u.shared_frames = 0;
+    u.saved_frames = 0;
+    for (unsigned int f = 0; f < num_pages; f++) {
+        if (core_map[f].proc != NULL && cow_shared(f)) {
+            u.shared_frames++;
+            u.saved_frames += core_map[f].more->size();
+        }
     }
+    return u;
+}
+
+template <class Policy>
+int fault(policy_shard<Policy>& shard, void *addr, bool write_flag);
 
-    //delete
-    clock_q.pop();
-    rm=NULL;
+//page vpn of proc, in a window onto a shared segment, is among the
+//mappings of frame f, which holds the segment's page
+bool window_mapped(unsigned int f, process_info* proc, unsigned int vpn)
+{
+    const vector<mapping>* more = core_map[f].more;
+    if (more == NULL)
+        return false;
+    for (size_t i = 0; i < more->size(); i++) {
+        if ((*more)[i].proc == proc && (*more)[i].vpn == vpn)
+            return true;
+    }
+    return false;
 }
 
+//fault on page vpn of the current process, in a window onto a shared
+//segment: the segment's page is faulted in as a page of the segment's
+//process, then the window's page joins the mappings of its frame.  The
+//segment's page keeps the reference and dirty bits of all its windows.
+//Faults on a segment's pages are serialised on the lock of its process,
+//taken after that of the faulting process, and run under the lock of the
+//segment's shard, which guards the window's page table entry; the
+//faulting process's shard is let go meanwhile.
+template <class Policy>
+int shm_fault(policy_shard<Policy>& shard, unsigned int vpn, bool write_flag)
+{
+    process_info* proc = current_process;
+    const shm_window& w = find_window(proc, vpn);
+    process_info* seg = w.seg->proc;
+    unsigned int k = vpn - w.first_vpn;
+    policy_shard<Policy>& seg_shard = shard_at<Policy>(seg->shard);
+    bool all = held_all;
+    if (pager_locking) {
+        drop_pager_lock();
+        pthread_mutex_lock(&seg->lock);
+        if (all) {
+            take_pager_lock();
+        } else {
+            held_shard = NULL;
+            lock_shard(seg_shard);
+        }
+    }
+
+    current_process = seg;
+    int ret = fault(seg_shard, (char *) VM_ARENA_BASEADDR + (unsigned long long) k * VM_PAGESIZE,
+            write_flag);
+    current_process = proc;
+
+    if (ret == 0) {
+        unsigned int f = seg->ptbl_ptr->ptes[k].ppage;
+        page_table_entry_t& pte = proc->ptbl_ptr->ptes[vpn];
+        if (!window_mapped(f, proc, vpn)) {
+            frame& fr = core_map[f];
+            if (fr.more == NULL)
+                fr.more = new vector<mapping>;
+            mapping m = {proc, vpn};
+            fr.more->push_back(m);
+            pte.ppage = f;
+        }
+        assert(pte.ppage == f);
+        pte.read_enable = 1;
+        pte.write_enable = seg->pages[k].dirty;
+    }
+    if (pager_locking) {
+        if (!all) {
+            unlock_shard();
+            lock_shard(shard);
+        }
+        pthread_mutex_unlock(&seg->lock);
+    }
+    return ret;
+}
 
 /*
  * vm_fault
@@ -207,119 +2730,461 @@ void remove(page* p) {
  * is true if the access that caused the fault is a write.
  * Should return 0 on success, -1 on failure.
  */
-int vm_fault(void *addr, bool write_flag) {
+template <class Policy>
+int fault(policy_shard<Policy>& shard, void *addr, bool write_flag) {
     //error checking
     //outside of arena
     if (((unsigned long long)addr - (unsigned long long)VM_ARENA_BASEADDR) >= (current_process->top_valid_index+1)*VM_PAGESIZE)
         return -1;
 
     //page number
-    page* p = current_process->pages[((unsigned long long)addr - (unsigned long long)VM_ARENA_BASEADDR) / VM_PAGESIZE];
+    unsigned int vpn = ((unsigned long long)addr - (unsigned long long)VM_ARENA_BASEADDR) / VM_PAGESIZE;
+    wait_for_io(current_process, vpn);
+    vpage* p = &current_process->pages[vpn];
+    page_table_entry_t* pte = &current_process->ptbl_ptr->ptes[vpn];
+
+    if (p->shm)
+        return shm_fault(shard, vpn, write_flag);
 
     p->reference = true;
+    if (p->resident == true) {
+        //(the engine goes by the reference bit of a shared frame's primary
+        //page)
+        core_map[pte->ppage].page().reference = true;
+        shard.engine.referenced(pte->ppage);
+        count_event(current_process, &pager_stats::minor_faults);
+        if (pte->read_enable == 0 && !p->readahead)
+            count_event(current_process, &pager_stats::reference_faults);
+    }
+    if (p->readahead) {
+        p->readahead = false;
+        current_process->ra_window = min((unsigned int) RA_MAX_PAGES, current_process->ra_window + 1);
+        count_event(current_process, &pager_stats::readahead_hits);
+    }
+
+    //a write to a shared frame gets a copy of it first
+    if (write_flag && p->resident && cow_shared(pte->ppage)) {
+        if (!copy_on_write(shard, vpn))
+            return -1;
+    }
 
     //Write
     if (write_flag==true) {
         if (p->resident == false) {
-            if (free_pages.empty()) {
-                evict();
+            unsigned int f;
+            if (!alloc_frame(shard, f)) {
+                return -1;
             }
-            p->pte_ptr->ppage = free_pages.top();
-            free_pages.pop();
+            pte->ppage = f;
+            //(finding the frame may have written the page out of the
+            //compressed cache)
+            wait_for_io(current_process, vpn);
 
             if(p->written_to==false)
             {
 //                for(unsigned int i = 0; i < VM_PAGESIZE;i++)
 //                {
-//                    *(((char *)pm_physmem)+i+p->pte_ptr->ppage*VM_PAGESIZE) = 0;
+//                    *(((char *)pm_physmem)+i+pte->ppage*VM_PAGESIZE) = 0;
 //                }
-                memset(((char *) pm_physmem) + p->pte_ptr->ppage * VM_PAGESIZE, 0,VM_PAGESIZE);
+                drop_pager_lock();
+                memset(frame_addr(pte->ppage), 0,VM_PAGESIZE);
+                take_pager_lock();
+                count_event(current_process, &pager_stats::zero_fills);
                 p->written_to = true;
             }
+            else if (p->zcached)
+            {
+                zcache_load(vpn);
+            }
             else
             {
-                disk_read(p->disk_block,p->pte_ptr->ppage);
+                page_in(shard, vpn);
             }
 
-            clock_q.push(p);
+            map_frame(shard, vpn);
             p->resident = true;
         }
 
-        p->pte_ptr->write_enable = 1;
-        p->pte_ptr->read_enable = 1;
+        pte->write_enable = 1;
+        pte->read_enable = 1;
         p->dirty = true;
+        //a disk copy shared with other pages stays theirs
+        if (p->disk_block != NO_BLOCK && block_shared(p->disk_block)) {
+            release_block(p->disk_block);
+            p->disk_block = NO_BLOCK;
+            save_page(current_process, vpn, true);
+        }
+        //a page that was zero-filled on a read has contents to save now
+        p->written_to = true;
     }
     //Read
     else {
         if (p->resident==false) {
-            if (free_pages.empty()) {
-                evict();
+            unsigned int f;
+            if (!alloc_frame(shard, f)) {
+                return -1;
             }
 
-            p->pte_ptr->ppage = free_pages.top();
-            free_pages.pop();
+            pte->ppage = f;
+            wait_for_io(current_process, vpn);
 
             if(p->written_to==false)
             {
 //                for(unsigned int i = 0; i < VM_PAGESIZE;i++)
 //                {
-//                    *(((char *)pm_physmem)+i+p->pte_ptr->ppage*VM_PAGESIZE) = 0;
+//                    *(((char *)pm_physmem)+i+pte->ppage*VM_PAGESIZE) = 0;
 //                }
-                memset(((char *) pm_physmem) + p->pte_ptr->ppage * VM_PAGESIZE, 0,VM_PAGESIZE);
+                drop_pager_lock();
+                memset(frame_addr(pte->ppage), 0,VM_PAGESIZE);
+                take_pager_lock();
+                count_event(current_process, &pager_stats::zero_fills);
                 p->dirty=false;
             }
+            else if (p->zcached)
+            {
+                zcache_load(vpn);
+            }
             else
             {
-                disk_read(p->disk_block, p->pte_ptr->ppage);
+                page_in(shard, vpn);
                 p->dirty=false;
             }
-            clock_q.push(p);
+            map_frame(shard, vpn);
             p->resident = true;
         }
 
-        if(p->dirty==true)
+        if(p->dirty==true && !cow_shared(pte->ppage))
         {
-            p->pte_ptr->write_enable = 1;
+            pte->write_enable = 1;
         }
         else
         {
-            p->pte_ptr->write_enable = 0;
+            pte->write_enable = 0;
         }
-        p->pte_ptr->read_enable = 1;
+        pte->read_enable = 1;
         p->reference = true;
     }
+    //a page advised sequential is used once: the one before it goes first
+    if (p->advice == VM_ADVISE_SEQUENTIAL && vpn > 0
+            && current_process->pages[vpn - 1].advice == VM_ADVISE_SEQUENTIAL)
+        deactivate(vpn - 1, vpn);
     p=NULL;
     return 0;
 }
 
+int dispatch_fault(void *addr, bool write_flag) {
+    count_event(current_process, &pager_stats::faults);
+    unsigned int k = current_process->shard;
+    switch (policy) {
+    case WSCLOCK:
+        return fault(shard_at<wsclock_policy>(k), addr, write_flag);
+    case CLOCKPRO:
+        return fault(shard_at<clockpro_policy>(k), addr, write_flag);
+    case ARC:
+        return fault(shard_at<arc_policy>(k), addr, write_flag);
+    case LRUK:
+        return fault(shard_at<lruk_policy>(k), addr, write_flag);
+    default:
+        return fault(shard_at<clock_policy>(k), addr, write_flag);
+    }
+}
+
+//vm_fault when recording events: the fault's time includes waiting for
+//the locks, and its kind is told from the counters it moved
+int logged_fault(void *addr, bool write_flag)
+{
+    uint64_t start = event_clock();
+    process_info* proc = current_process;
+    int ret;
+    uint8_t kind;
+    {
+        pager_guard guard(proc);
+        unsigned long long major_faults = proc->stats.major_faults;
+        unsigned long long zero_fills = proc->stats.zero_fills;
+        ret = dispatch_fault(addr, write_flag);
+        if (ret != 0)
+            kind = FAULT_REFUSED;
+        else if (proc->stats.major_faults != major_faults)
+            kind = FAULT_MAJOR;
+        else if (proc->stats.zero_fills != zero_fills)
+            kind = FAULT_ZERO;
+        else
+            kind = FAULT_MINOR;
+    }
+    unsigned long long offset = (unsigned long long) addr - (unsigned long long) VM_ARENA_BASEADDR;
+    log_event(EVENT_FAULT, kind | (write_flag ? EVENT_WRITE : 0), proc->pid,
+            min(offset / VM_PAGESIZE, (unsigned long long) UINT32_MAX), start);
+    return ret;
+}
+
+int vm_fault(void *addr, bool write_flag) {
+    if (event_log.enabled())
+        return logged_fault(addr, write_flag);
+    pager_guard guard(current_process);
+    return dispatch_fault(addr, write_flag);
+}
+
 /*
  * vm_destroy
  *
  * Called when current process exits.  It should deallocate all resources
  * held by the current process (page table, physical pages, disk blocks, etc.)
  */
-void vm_destroy() {
-    for (unsigned int i = 0; i <=current_process->top_valid_index; i++) {
-        page* p = current_process->pages[i];
+template <class Policy>
+void destroy(policy_shard<Policy>& shard) {
+    //(writes still in flight must not record the pages in the slot's next
+    //process)
+    if (current_process->state_slot != NO_SLOT) {
+        state.free_slot(current_process->state_slot);
+        current_process->state_slot = NO_SLOT;
+    }
+    for (int i = 0; i <=current_process->top_valid_index; i++) {
+        wait_for_io(current_process, i);
+        vpage* p = &current_process->pages[i];
+        page_table_entry_t* pte = &current_process->ptbl_ptr->ptes[i];
         //if page in physmem
-        if (p->resident==true) {
-            free_pages.push(p->pte_ptr->ppage);
-            remove(p);
+        if (p->shm) {
+            //(a window's page table entry may be stale: the frame's
+            //mappings tell whether it still maps the segment's page)
+            if (window_mapped(pte->ppage, current_process, i))
+                unmap_shared(pte->ppage, current_process, i);
+        } else if (p->resident==true && core_map[pte->ppage].more != NULL) {
+            unmap_shared(pte->ppage, current_process, i);
+        } else if (p->resident==true) {
+            shard.engine.remove(pte->ppage);
+            shard.engine_frames--;
+            core_map[pte->ppage].proc = NULL;
+            free_frame(shard, pte->ppage);
+        } else {
+            shard.engine.forget(make_page_key(current_id, i));
+            if (p->zcached)
+                zcache_unmap(current_process, i);
         }
-        free_disk_blocks.push(p->disk_block);
+        if (p->disk_block != NO_BLOCK)
+            release_block(p->disk_block);
         p->valid= false;
-        delete p;
-        p=NULL;
     }
-        //delete current_process->ptbl_ptr;
-        //delete [] current_process->pages;
-        delete current_process;
-        process_map.erase(current_id);
+    unreserve_swap(current_process->top_valid_index + 1 - window_pages(current_process));
+    shard.reclaimable -= excess_frames(current_process);
+    current_process->rss = 0;
+    free_page_table(current_process->ptbl_ptr, current_process->top_valid_index);
+    remove_process(current_id);
+    wake_waiters(shard);
 
     current_process=NULL;
     page_table_base_register=NULL;
 }
 
+void dispatch_destroy() {
+    unsigned int k = current_process->shard;
+    switch (policy) {
+    case WSCLOCK:
+        destroy(shard_at<wsclock_policy>(k));
+        break;
+    case CLOCKPRO:
+        destroy(shard_at<clockpro_policy>(k));
+        break;
+    case ARC:
+        destroy(shard_at<arc_policy>(k));
+        break;
+    case LRUK:
+        destroy(shard_at<lruk_policy>(k));
+        break;
+    default:
+        destroy(shard_at<clock_policy>(k));
+        break;
+    }
+}
+
+//destroy a segment no process has a window onto any more, as the
+//segment's process, then go back to the process the thread runs as
+void free_segment(shm_segment* s)
+{
+    process_info* proc = current_process;
+    pid_t id = current_id;
+    page_table_t* ptbr = page_table_base_register;
+    current_process = s->proc;
+    current_id = s->proc->pid;
+    dispatch_destroy();
+    current_process = proc;
+    current_id = id;
+    page_table_base_register = ptbr;
+    pthread_mutex_destroy(&s->proc->lock);
+    delete s->proc;
+    delete s;
+}
+
+void vm_destroy() {
+    process_info* proc = current_process;
+    {
+        //(a process going takes every shard: its windows map frames of
+        //others, and the process map changes)
+        pager_guard guard(proc, true);
+        dispatch_destroy();
+        //an unlinked segment goes with its last window
+        for (size_t i = 0; i < proc->windows.size(); i++) {
+            shm_segment* s = proc->windows[i].seg;
+            if (--s->attached == 0 && s->unlinked)
+                free_segment(s);
+        }
+    }
+    //no frame of the process is left for another thread to reach it by
+    if (stats_dumps) {
+        write_stats(cerr, proc->stats, proc->pid, stats_json);
+        cerr << endl;
+    }
+    pthread_mutex_destroy(&proc->lock);
+    delete proc;
+}
+
+/*
+ * vm_shm_attach
+ *
+ * Called when the current process attaches the shared segment "name" of
+ * "pages" pages, creating it if there is none by that name.  The window
+ * onto it takes the next "pages" pages of the arena, which fault in the
+ * segment's pages (see shm_fault).  The segment holds the swap reservation
+ * for its pages; the windows hold none.  Returns the lowest-numbered byte
+ * of the window, or NULL on error.
+ */
+void * vm_shm_attach(const char *name, unsigned int pages) {
+    process_info* proc = current_process;
+    pager_guard guard(proc, true);
+    if (pages == 0 || pages > (unsigned int) (VM_ARENA_SIZE / VM_PAGESIZE - (proc->top_valid_index + 1)))
+        return NULL;
+
+    shm_segment* s;
+    unordered_map<string, shm_segment*>::iterator i = segments.find(name);
+    if (i != segments.end()) {
+        s = i->second;
+        if (s->proc->top_valid_index + 1 != (int) pages)
+            return NULL;
+    } else {
+        if (!reserve_swap(pages))
+            return NULL;
+        s = new shm_segment;
+        s->name = name;
+        s->attached = 0;
+        s->unlinked = false;
+        s->proc = new_process(next_segment_pid--);
+        s->proc->segment = true;
+        //(its frames come from the shard of the process creating it)
+        s->proc->shard = proc->shard;
+        //the segment's frames are reclaimed like those of any process
+        //beyond its guarantee
+        s->proc->rss_min = 0;
+        s->proc->rss_max = 0;
+        append_pages(s->proc, pages, false);
+        segments[name] = s;
+    }
+
+    s->attached++;
+    shm_window w = {(unsigned int) (proc->top_valid_index + 1), pages, s};
+    proc->windows.push_back(w);
+    append_pages(proc, pages, true);
+    return (void *) ((unsigned long long) VM_ARENA_BASEADDR + (unsigned long long) w.first_vpn * VM_PAGESIZE);
+}
+
+/*
+ * vm_shm_unlink
+ *
+ * Called when the current process removes the name of the shared segment
+ * "name".  The segment is freed once no process has a window onto it.
+ */
+int vm_shm_unlink(const char *name) {
+    pager_guard guard(current_process, true);
+    unordered_map<string, shm_segment*>::iterator i = segments.find(name);
+    if (i == segments.end())
+        return -1;
+    shm_segment* s = i->second;
+    segments.erase(i);
+    s->unlinked = true;
+    if (s->attached == 0)
+        free_segment(s);
+    return 0;
+}
+
+/*
+ * vm_release
+ *
+ * Called when the current process discards the pages lying wholly in the
+ * "len" bytes at "addr" (see release).  Returns 0 on success, -1 if the
+ * range is empty or not all valid.
+ */
+int vm_release(void *addr, unsigned int len) {
+    pager_guard guard(current_process);
+    unsigned int first, end;
+    if (!arena_range(addr, len, true, first, end))
+        return -1;
+    switch (policy) {
+    case WSCLOCK:
+        release(shard_at<wsclock_policy>(current_process->shard), first, end);
+        break;
+    case CLOCKPRO:
+        release(shard_at<clockpro_policy>(current_process->shard), first, end);
+        break;
+    case ARC:
+        release(shard_at<arc_policy>(current_process->shard), first, end);
+        break;
+    case LRUK:
+        release(shard_at<lruk_policy>(current_process->shard), first, end);
+        break;
+    default:
+        release(shard_at<clock_policy>(current_process->shard), first, end);
+        break;
+    }
+    return 0;
+}
+
+/*
+ * vm_advise
+ *
+ * Called when the current process gives a hint about the pages overlapping
+ * the "len" bytes at "addr".  Sequential and random are kept in the pages
+ * for page_in's read-ahead and vm_fault's drop-behind; willneed reads the
+ * pages in (see prefetch); dontneed makes them the next eviction candidates
+ * (see deactivate).  Returns 0 on success, -1 on error.
+ */
+int vm_advise(void *addr, unsigned int len, int hint) {
+    pager_guard guard(current_process);
+    unsigned int first, end;
+    if (!arena_range(addr, len, false, first, end))
+        return -1;
+    switch (hint) {
+    case VM_ADVISE_NORMAL:
+    case VM_ADVISE_SEQUENTIAL:
+    case VM_ADVISE_RANDOM:
+        for (unsigned int vpn = first; vpn < end; vpn++)
+            current_process->pages[vpn].advice = hint;
+        break;
+    case VM_ADVISE_WILLNEED:
+        switch (policy) {
+        case WSCLOCK:
+            prefetch(shard_at<wsclock_policy>(current_process->shard), first, end);
+            break;
+        case CLOCKPRO:
+            prefetch(shard_at<clockpro_policy>(current_process->shard), first, end);
+            break;
+        case ARC:
+            prefetch(shard_at<arc_policy>(current_process->shard), first, end);
+            break;
+        case LRUK:
+            prefetch(shard_at<lruk_policy>(current_process->shard), first, end);
+            break;
+        default:
+            prefetch(shard_at<clock_policy>(current_process->shard), first, end);
+            break;
+        }
+        break;
+    case VM_ADVISE_DONTNEED:
+        deactivate(first, end);
+        break;
+    default:
+        return -1;
+    }
+    return 0;
+}
+
 /*
  * vm_syslog
  *
@@ -329,6 +3194,9 @@ void vm_destroy() {
  * Should return 0 on success, -1 on failure.
  */
 int vm_syslog(void *message, unsigned int len) {
+    uint64_t start = event_start();
+    //(a fault in a window takes the segment's shard, see shm_fault)
+    pager_guard guard(current_process, !current_process->windows.empty());
     //if not all of message is within the arena, return error
     //if len = 0, return error
     if (
@@ -346,16 +3214,19 @@ int vm_syslog(void *message, unsigned int len) {
         unsigned int page_num = ((unsigned long long) message - (unsigned long long) VM_ARENA_BASEADDR + i) / VM_PAGESIZE;
         unsigned int page_offset = ((unsigned long long) message - (unsigned long long) VM_ARENA_BASEADDR + i) % VM_PAGESIZE;
         unsigned int pf = page_table_base_register->ptes[page_num].ppage;
+        const vpage& p = current_process->pages[page_num];
         if (page_table_base_register->ptes[page_num].read_enable == 0
-                || current_process->pages[page_num]->resident==false) {
-            if (vm_fault((void *) ((unsigned long long) message + i), false)) {
+                || (p.resident==false && !p.shm)) {
+            if (dispatch_fault((void *) ((unsigned long long) message + i), false)) {
+                log_event(EVENT_SYSLOG, 0, current_id, len, start);
                 return -1;
             }
             pf = page_table_base_register->ptes[page_num].ppage;
         }
-        current_process->pages[page_num]->reference=true;
-        s.append((char *)pm_physmem+pf * VM_PAGESIZE+ page_offset,1);
+        current_process->pages[page_num].reference=true;
+        s.append(frame_addr(pf) + page_offset,1);
     }
     cout << "syslog\t\t\t" << s << endl;
+    log_event(EVENT_SYSLOG, 0, current_id, len, start);
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,287 @@
+/*
+ * pager.h
+ *
+ * Interface of pager.cc beyond vm_pager.h, for the tools built around the
+ * pager (simulator drivers, trace replay, benchmarks).
+ */
+
+#ifndef _PAGER_H_
+#define _PAGER_H_
+
+#include <iosfwd>
+#include <sys/types.h>
+
+/*
+ * Paging counters, kept for each process and for the whole pager
+ * (pager_totals).  Events are counted against the process that owns the
+ * page, e.g. an eviction against the process losing the page.  Each set
+ * has cache lines of its own.  A process's counters are updated with its
+ * shard's lock held; when the pager locks, the totals are added to
+ * atomically, as threads of several shards count into them.
+ */
+struct alignas(64) pager_stats {
+    unsigned long long faults;              // calls to vm_fault
+    unsigned long long major_faults;        // faults reading the page from disk
+    unsigned long long zero_fills;          // faults filling the page with zeros
+    unsigned long long minor_faults;        // faults on resident pages
+    unsigned long long reference_faults;    // minor faults on pages the
+                                            // engine revoked (see revocations)
+    unsigned long long revocations;         // resident pages whose access the
+                                            // engine revoked to sample the
+                                            // reference bit
+    unsigned long long evictions;           // resident pages evicted
+    unsigned long long limit_evictions;     // of which by the process itself,
+                                            // at its resident set limit
+    unsigned long long zero_pages;          // dirty pages found to be all zeros
+                                            // when written back, dropped
+    unsigned long long fg_writebacks;       // pages written back by faults
+    unsigned long long bg_writebacks;       // and by the cleaner
+    unsigned long long readahead_pages;     // pages read ahead of faults
+    unsigned long long readahead_hits;      // and later used
+    unsigned long long cow_copies;          // shared frames copied on a write
+    unsigned long long merged_pages;        // pages moved into a frame with
+                                            // the same contents by the dedup
+                                            // scanner
+    unsigned long long zcache_stores;       // evicted pages compressed into
+                                            // the compressed swap cache
+    unsigned long long zcache_bytes;        // and their compressed size
+    unsigned long long zcache_rejects;      // evicted pages that did not
+                                            // compress enough, written to disk
+    unsigned long long zcache_hits;         // faults decompressing the page
+                                            // from the cache
+    unsigned long long zcache_writebacks;   // pages moved from the cache to
+                                            // disk to make room
+    unsigned long long released_pages;      // pages discarded by vm_release
+    unsigned long long hand_steps;          // frames examined by the engine
+                                            // for a victim (totals only)
+};
+
+extern pager_stats pager_totals;
+
+/*
+ * Snapshots of the counters: those of process "pid" (false if there is no
+ * such process), and the totals.  Safe to call while other threads are in
+ * the pager.
+ */
+extern bool pager_process_stats(pid_t pid, pager_stats *stats);
+extern pager_stats pager_total_stats();
+
+/*
+ * Write the counters of every live process and the totals to "out", one
+ * line per set as text, or as a single JSON object.
+ */
+extern void pager_dump_stats(std::ostream &out, bool json);
+
+/*
+ * Automatic dumps to stderr, "text" or "json" (from $PAGER_STATS if the
+ * driver leaves it NULL): the counters of each process as it is destroyed,
+ * and the totals at exit.  NULL for none.
+ */
+extern const char *pager_stats_format;
+
+/*
+ * Event recording.  If pager_events names a file (from $PAGER_EVENTS if the
+ * driver leaves it NULL), vm_init starts recording every fault, eviction,
+ * disk request, switch and syslog, with its timestamp and duration, into a
+ * ring holding the last 2^pager_event_order events (default 2^20, 32 bytes
+ * each), and the ring is saved to the file at exit.  Recording takes no
+ * lock.  pager_save_events saves the ring at any time; false if it cannot
+ * write "path" or nothing is being recorded.  build/events turns the file
+ * into a Chrome trace and latency histograms (see event_log.h).
+ */
+extern const char *pager_events;
+extern unsigned int pager_event_order;
+extern bool pager_save_events(const char *path);
+
+/*
+ * Resident set limits.  A process is guaranteed rss_min frames: while other
+ * processes hold frames beyond their own guarantee, eviction passes over
+ * the pages of processes within theirs.  A process at its hard limit
+ * rss_max (0 for none) evicts one of its own pages, by a clock over its
+ * pages, for each page it faults in, and reads nothing ahead.  New
+ * processes get pager_rss_min and pager_rss_max (from $PAGER_RSS_MIN and
+ * $PAGER_RSS_MAX if the driver leaves them 0); pager_set_rss_limits
+ * changes them, false if there is no such process or min exceeds a
+ * non-zero max.  A process above a lowered limit gives frames back as it
+ * faults.  pager_process_rss reports the frames a process holds and its
+ * limits, which pager_dump_stats also writes.
+ */
+struct rss_usage {
+    unsigned int resident;
+    unsigned int min;
+    unsigned int max;
+};
+
+extern unsigned int pager_rss_min;
+extern unsigned int pager_rss_max;
+extern bool pager_set_rss_limits(pid_t pid, unsigned int min, unsigned int max);
+extern bool pager_process_rss(pid_t pid, rss_usage *rss);
+
+/*
+ * Deduplication.  If pager_dedup_pages is non-zero (from $PAGER_DEDUP_PAGES if
+ * the driver leaves it 0), vm_init starts a thread that scans that many
+ * frames every pager_dedup_sleep_ms milliseconds (from $PAGER_DEDUP_SLEEP_MS,
+ * default 20).  Each scanned page is hashed, and left writable; a page
+ * whose hash has not changed since the scanner's last pass is merged with a
+ * page of the same contents in the same shard, found by its hash and
+ * confirmed by comparing the bytes with both pages write-protected, by
+ * mapping it read-only to that page's frame, shared copy-on-write as after
+ * vm_fork, and freeing its own.  A pair whose bytes differ is made writable
+ * again.  A write to a merged page copies it again (cow_copies).  All-zero
+ * pages are left alone.
+ * pager_dedup_scan scans "frames" frames at once, from any thread, and
+ * returns the number of pages merged.  pager_dedup_usage reports the
+ * scanner's work and what sharing saves now.
+ */
+struct dedup_usage {
+    unsigned long long scanned;     // frames hashed
+    unsigned long long merged;      // pages merged (merged_pages in total)
+    unsigned int shared_frames;     // frames shared copy-on-write now, by
+                                    // merges or forks
+    unsigned int saved_frames;      // frames their sharing saves
+};
+
+extern unsigned int pager_dedup_pages;
+extern unsigned int pager_dedup_sleep_ms;
+extern unsigned int pager_dedup_scan(unsigned int frames);
+extern dedup_usage pager_dedup_usage();
+
+/*
+ * Compressed swap cache.  If pager_zcache_frames is non-zero (from
+ * $PAGER_ZCACHE_FRAMES if the driver leaves it 0), vm_init sets that many
+ * of the top physical pages aside, at most half of them, to hold evicted
+ * dirty pages compressed (see lz_page.h) instead of writing them to disk.
+ * A page that does not compress to 3/4 of its size is written to disk as
+ * before.  A fault on a cached page decompresses it, with no disk read.
+ * When the cache is full, its oldest pages are written to disk to make
+ * room.  The counters zcache_* follow the cache's work, and
+ * pager_zcache_usage what it holds now.  The cache is off by default: the
+ * simulated disk costs no more than a memory copy, so compressing and
+ * decompressing make faults slower here, and only disk transfers drop.
+ */
+struct zcache_usage {
+    unsigned int frames;            // physical pages holding the cache
+    unsigned int pages;             // compressed pages in it
+    unsigned long long bytes;       // their compressed size
+    unsigned long long free_bytes;  // room left
+};
+
+extern unsigned int pager_zcache_frames;
+extern zcache_usage pager_zcache_usage();
+
+/*
+ * Warm restart.  If pager_state names a file (from $PAGER_STATE if the
+ * driver leaves it NULL), the pager keeps every process's pages and their
+ * disk blocks in it, mapped into memory (see state_file.h), updating a
+ * page's record as soon as a write-back completes or its block is freed.
+ * If the file holds the processes of an earlier pager on the same disk,
+ * vm_init resumes them, without reading the disk: each page reads back the
+ * contents it last wrote back, and pages that were never written back, or
+ * only into the compressed swap cache, read as zeros, as do windows onto
+ * shared segments, which are not kept.  If pager_warm is set (from
+ * $PAGER_WARM), a thread then reads the pages that were resident back in,
+ * as read-ahead, until a sixteenth of the frames is left free.
+ * pager_checkpoint writes the dirty pages, except those of frames shared
+ * copy-on-write, and the compressed swap cache to disk, and flushes the
+ * file; false if there is no state file or the disk is full.
+ * pager_restore_usage reports what vm_init resumed.
+ */
+struct restore_usage {
+    unsigned int processes;         // processes resumed
+    unsigned int pages;             // their pages with a disk block
+    unsigned int warm_pages;        // pages read back in by the warm-up
+    bool warming;                   // the warm-up is still running
+};
+
+extern const char *pager_state;
+extern unsigned int pager_warm;
+extern bool pager_checkpoint();
+extern restore_usage pager_restore_usage();
+
+/*
+ * page tables held by live processes.  Tables of destroyed processes are
+ * pooled for reuse, at most 64 of them with at most 64 KiB of committed
+ * entries each; the rest of a table is a demand-zero mapping.
+ */
+extern unsigned int pager_page_tables;
+
+/*
+ * Page replacement engine selected by vm_init: "clock" (the default),
+ * "wsclock", "clockpro", "arc" or "lruk" (see replace.h).  If the driver
+ * leaves it NULL, vm_init takes it from $PAGER_POLICY.
+ */
+extern const char *pager_policy;
+
+/*
+ * Background cleaner.  If pager_clean_low is non-zero (from $PAGER_CLEAN_LOW
+ * if the driver leaves it 0), vm_init starts a thread that writes back dirty
+ * pages the replacement engine has already swept, whenever fewer than
+ * pager_clean_low frames are free or clean, until pager_clean_high are
+ * (default twice the low watermark).
+ */
+extern unsigned int pager_clean_low;
+extern unsigned int pager_clean_high;
+
+/*
+ * Stop the cleaner and dedup scanner threads vm_init started, waiting for
+ * the pass each is in to finish.  Drivers call it when they are done with
+ * the pager, from a thread not inside a pager call.  Without it the
+ * threads run until the process exits, which is harmless: they hold
+ * nothing but the pager's memory.  It is not called at exit, as exit may
+ * come from inside the pager with a lock held.  The warm-up thread (see
+ * pager_warm) ends on its own.
+ */
+extern void pager_shutdown();
+
+/*
+ * Number of threads that call into the pager at the same time, each running
+ * its own processes (from $PAGER_THREADS if the driver leaves it 0).  Each
+ * thread has its own current process and page table base register.  With
+ * more than one, vm_init makes the pager lock its entry points: calls made
+ * as the same process are serialised, and faults of different processes
+ * overlap their disk I/O and page zeroing.
+ */
+extern unsigned int pager_threads;
+
+/*
+ * Number of shards physical memory is split into (from $PAGER_SHARDS if the
+ * driver leaves it 0, else one per pager thread), at most one per 64
+ * frames.  Each shard has its own lock, free frames, replacement engine,
+ * cleaner reserve and compressed swap cache, and a process takes all its
+ * frames from one shard, so faults of processes of different shards do not
+ * contend.  The partition is hard: a process cannot take frames of another
+ * shard even when its own has none free.
+ */
+extern unsigned int pager_shards;
+
+/*
+ * Swap accounting selected by vm_init, from $PAGER_OVERCOMMIT if the driver
+ * leaves it NULL.  vm_extend only reserves swap; a disk block is bound to a
+ * page the first time it is written back.  The modes limit the reservation:
+ *
+ *   "strict" (the default)  at most one page per disk block, so a write-back
+ *                           always finds a block
+ *   "heuristic"             disk blocks plus physical memory pages
+ *   "unlimited"             no limit
+ *
+ * When an overcommitted disk is full, a fault that has to write back a page
+ * without a block fails, as if the process had run out of memory.
+ */
+extern const char *pager_overcommit;
+
+/* pages currently holding a swap reservation */
+extern unsigned int pager_swap_reserved;
+
+/*
+ * Fragmentation of swap: the free disk blocks, the number of free extents
+ * (runs of consecutive free blocks) they form, and the longest of those.
+ */
+struct swap_usage {
+    unsigned int free_blocks;
+    unsigned int extents;
+    unsigned int largest_extent;
+};
+
+extern swap_usage pager_swap_usage();
+
+#endif /* _PAGER_H_ */
@@ -0,0 +1,36 @@
+/*
+ * physmem.cc
+ *
+ * Physical memory and MMU registers for the in-process simulator.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "vm_pager.h"
+#include "vm_sim.h"
+
+void *pm_physmem;
+thread_local page_table_t *page_table_base_register;
+
+int pm_fd = -1;
+unsigned int pm_pages;
+
+void pm_init(unsigned int memory_pages)
+{
+    size_t size = (size_t) memory_pages * VM_PAGESIZE;
+
+    pm_fd = memfd_create("physmem", 0);
+    if (pm_fd < 0 || ftruncate(pm_fd, size) < 0) {
+        perror("physmem");
+        exit(1);
+    }
+    pm_physmem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, pm_fd, 0);
+    if (pm_physmem == MAP_FAILED) {
+        perror("physmem");
+        exit(1);
+    }
+    pm_pages = memory_pages;
+    page_table_base_register = NULL;
+}
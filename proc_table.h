@@ -0,0 +1,120 @@
+/*
+ * proc_table.h
+ *
+ * Process table of the pager: pid -> process_info, an open-addressing hash
+ * table with linear probing.  Lookups touch one or two adjacent slots
+ * instead of walking a tree, and deletion shifts the following entries of
+ * the probe run back, so there are no tombstones and lookups stay short
+ * under constant process churn.
+ */
+
+#ifndef _PROC_TABLE_H_
+#define _PROC_TABLE_H_
+
+#include <cstddef>
+#include <vector>
+#include "page.h"
+
+class proc_table {
+public:
+    proc_table() : count(0), mask(0), shift(32)
+    {
+    }
+
+    process_info* find(pid_t pid) const
+    {
+        if (count == 0)
+            return NULL;
+        for (size_t i = slot(pid); slots[i].proc != NULL; i = (i + 1) & mask)
+            if (slots[i].pid == pid)
+                return slots[i].proc;
+        return NULL;
+    }
+
+    void insert(pid_t pid, process_info* proc)
+    {
+        // keep the load factor at or below 1/2
+        if (2 * (count + 1) > slots.size())
+            grow();
+        size_t i = slot(pid);
+        while (slots[i].proc != NULL && slots[i].pid != pid)
+            i = (i + 1) & mask;
+        if (slots[i].proc == NULL)
+            count++;
+        slots[i].pid = pid;
+        slots[i].proc = proc;
+    }
+
+    void erase(pid_t pid)
+    {
+        if (count == 0)
+            return;
+        size_t i = slot(pid);
+        while (slots[i].pid != pid || slots[i].proc == NULL) {
+            if (slots[i].proc == NULL)
+                return;
+            i = (i + 1) & mask;
+        }
+        count--;
+
+        // move back any entry of the run that can no longer be reached
+        for (size_t j = (i + 1) & mask; slots[j].proc != NULL; j = (j + 1) & mask) {
+            size_t home = slot(slots[j].pid);
+            if (((j - home) & mask) >= ((j - i) & mask)) {
+                slots[i] = slots[j];
+                i = j;
+            }
+        }
+        slots[i].proc = NULL;
+    }
+
+    size_t size() const
+    {
+        return count;
+    }
+
+    // call fn(proc) for every process in the table, in no particular order
+    template <class Fn>
+    void for_each(Fn fn) const
+    {
+        for (size_t i = 0; i < slots.size(); i++)
+            if (slots[i].proc != NULL)
+                fn(slots[i].proc);
+    }
+
+private:
+    struct entry {
+        pid_t pid;
+        process_info* proc;     // NULL for an empty slot
+    };
+
+    size_t slot(pid_t pid) const
+    {
+        // Fibonacci hashing: the top bits of pid * 2^32 / phi, so
+        // consecutive pids land far apart
+        if (shift == 32)
+            return 0;
+        return ((unsigned int) pid * 2654435769U) >> shift;
+    }
+
+    void grow()
+    {
+        std::vector<entry> old;
+        old.swap(slots);
+        slots.assign(old.empty() ? 16 : 2 * old.size(), entry());
+        mask = slots.size() - 1;
+        for (shift = 32; ((size_t) 1 << (32 - shift)) < slots.size(); shift--)
+            ;
+        count = 0;
+        for (size_t i = 0; i < old.size(); i++)
+            if (old[i].proc != NULL)
+                insert(old[i].pid, old[i].proc);
+    }
+
+    std::vector<entry> slots;
+    size_t count;
+    size_t mask;
+    unsigned int shift;
+};
+
+#endif /* _PROC_TABLE_H_ */
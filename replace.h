@@ -0,0 +1,834 @@
+/*
+ * replace.h
+ *
+ * Page replacement engines.  vm_init selects one engine, and pager.cc
+ * instantiates the fault path once per engine, so the calls below are
+ * resolved at compile time and inlined.  Engines work on physical page
+ * numbers ("frames") and find the page in a frame through the core map.
+ * An engine manages one shard of physical memory (see pager_shards), a
+ * range of consecutive frames.  Every engine implements:
+ *
+ *   void init(unsigned int first,      the engine manages frames first to
+ *             unsigned int frames)     first+frames-1
+ *   void insert(unsigned int f)        a page was just brought into frame f
+ *   void referenced(unsigned int f)    fault on the page resident in frame f
+ *   void remove(unsigned int f)        frame f is being freed without an
+ *                                      eviction (its process is destroyed)
+ *   void forget(page_key key)          a non-resident page is destroyed
+ *   unsigned int victim(Keep keep)     choose a frame to evict and forget
+ *                                      about it, passing over the frames
+ *                                      keep(f) returns true for as if they
+ *                                      were not candidates yet
+ *   void reinstate(unsigned int f)     frame f, just taken by victim() or
+ *                                      remove(), keeps its page after all
+ *                                      (it is busy, or cannot be written
+ *                                      back): undo what the taking recorded
+ *                                      and put it back where it was
+ *
+ * keep lets the pager spare the frames it must not evict without taking
+ * them out of the engine, so they keep their history.  It must return
+ * true fewer times in one call than the engine holds frames.
+ *
+ * Engines observe references only through the reference bit of the page,
+ * which vm_fault sets on every fault.  clear_reference() clears the bit and
+ * revokes access so the next access faults again.  Because the access that
+ * brings a page in also sets the bit, the scan-resistant engines treat the
+ * first reference bit they see on a new page as part of its insertion, not
+ * as a re-reference.  Each step of an engine's hand (or each candidate
+ * it examines) counts in pager_totals.hand_steps (see count_total).
+ */
+
+#ifndef _REPLACE_H_
+#define _REPLACE_H_
+
+#include <algorithm>
+#include <cassert>
+#include <list>
+#include <set>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "page.h"
+
+#define FRAME_NIL (~0U)
+
+/*
+ * Circular doubly linked lists threaded through per-frame (or per-node)
+ * link arrays.  A node is on at most one list of a given frame_links.
+ */
+struct frame_list {
+    unsigned int head;
+    unsigned int size;
+
+    frame_list() : head(FRAME_NIL), size(0) {}
+};
+
+class frame_links {
+public:
+    void init(unsigned int n)
+    {
+        next.assign(n, FRAME_NIL);
+        prev.assign(n, FRAME_NIL);
+    }
+
+    void grow(unsigned int n)
+    {
+        next.resize(n, FRAME_NIL);
+        prev.resize(n, FRAME_NIL);
+    }
+
+    unsigned int after(unsigned int f) const
+    {
+        return next[f];
+    }
+
+    // insert f just before "pos" on list l (at the tail if pos is l.head)
+    void insert_before(frame_list& l, unsigned int pos, unsigned int f)
+    {
+        if (l.head == FRAME_NIL) {
+            next[f] = prev[f] = f;
+            l.head = f;
+        } else {
+            next[f] = pos;
+            prev[f] = prev[pos];
+            next[prev[pos]] = f;
+            prev[pos] = f;
+        }
+        l.size++;
+    }
+
+    void push_back(frame_list& l, unsigned int f)
+    {
+        insert_before(l, l.head, f);
+    }
+
+    void remove(frame_list& l, unsigned int f)
+    {
+        if (next[f] == f) {
+            l.head = FRAME_NIL;
+        } else {
+            next[prev[f]] = next[f];
+            prev[next[f]] = prev[f];
+            if (l.head == f)
+                l.head = next[f];
+        }
+        next[f] = prev[f] = FRAME_NIL;
+        l.size--;
+    }
+
+private:
+    std::vector<unsigned int> next;
+    std::vector<unsigned int> prev;
+};
+
+/*
+ * CLOCK (second chance): the hand sweeps the core map in place; a
+ * referenced page under the hand has its reference bit cleared and is
+ * passed over.
+ */
+class clock_policy {
+public:
+    void init(unsigned int first, unsigned int frames)
+    {
+        base = first;
+        hand = first;
+        end = first + frames;
+    }
+
+    void insert(unsigned int f)
+    {
+    }
+
+    void referenced(unsigned int f)
+    {
+    }
+
+    void remove(unsigned int f)
+    {
+    }
+
+    void forget(page_key key)
+    {
+    }
+
+    void reinstate(unsigned int f)
+    {
+    }
+
+    template <class Keep>
+    unsigned int victim(Keep keep)
+    {
+        for (;;) {
+            count_total(&pager_stats::hand_steps);
+            unsigned int f = hand;
+            if (++hand == end)
+                hand = base;
+
+            if (core_map[f].proc == NULL)
+                continue;
+            if (core_map[f].page().reference == false) {
+                if (keep(f))
+                    continue;
+                return f;
+            }
+            clear_reference(f);
+        }
+    }
+
+private:
+    unsigned int base;
+    unsigned int hand;
+    unsigned int end;
+};
+
+/*
+ * WSClock: CLOCK over the time of last use.  Unreferenced pages older than
+ * the working-set window tau are evicted, clean ones first; dirty ones are
+ * only taken after a full revolution finds no clean candidate.  Time is
+ * virtual: it advances by one on every fault.
+ */
+class wsclock_policy {
+public:
+    void init(unsigned int first, unsigned int frames)
+    {
+        base = first;
+        n = frames;
+        hand = first;
+        last_use.assign(frames, 0);
+        tau = std::max(1U, frames / 2);
+        now = 0;
+    }
+
+    void insert(unsigned int f)
+    {
+        now++;
+        last_use[f - base] = now;
+    }
+
+    void referenced(unsigned int f)
+    {
+        now++;
+    }
+
+    void remove(unsigned int f)
+    {
+    }
+
+    void forget(page_key key)
+    {
+    }
+
+    void reinstate(unsigned int f)
+    {
+    }
+
+    template <class Keep>
+    unsigned int victim(Keep keep)
+    {
+        for (size_t scanned = 0; ; scanned++) {
+            count_total(&pager_stats::hand_steps);
+            unsigned int f = hand;
+            if (++hand == base + n)
+                hand = base;
+
+            if (core_map[f].proc == NULL)
+                continue;
+            const vpage& p = core_map[f].page();
+            if (p.reference) {
+                clear_reference(f);
+                last_use[f - base] = now;
+            } else if (scanned >= 2 * n ||
+                    (now - last_use[f - base] > tau && (!needs_writeback(p) || scanned >= n))) {
+                if (!keep(f))
+                    return f;
+            }
+        }
+    }
+
+private:
+    unsigned int base;
+    unsigned int n;
+    unsigned int hand;
+    std::vector<unsigned long long> last_use;     // by frame - base
+    unsigned long long tau;
+    unsigned long long now;
+};
+
+/*
+ * ARC, in its reference-bit form CAR (Bansal and Modha, "CAR: Clock with
+ * Adaptive Replacement").  T1 holds pages seen once, T2 pages seen more than
+ * once, both as clocks; B1 and B2 remember the keys of pages recently
+ * evicted from T1 and T2.  A miss that hits B1 grows the target size of T1,
+ * one that hits B2 shrinks it.
+ */
+class arc_policy {
+public:
+    void init(unsigned int first, unsigned int frames)
+    {
+        base = first;
+        c = frames;
+        target = 0;
+        links.init(frames);
+        in_t2.assign(frames, false);
+        fresh.assign(frames, false);
+    }
+
+    void insert(unsigned int f)
+    {
+        unsigned int i = f - base;
+        fresh[i] = true;
+
+        ghost_map::iterator g = ghosts.find(core_map[f].key());
+        if (g == ghosts.end()) {
+            // history miss: keep |T1| + |B1| <= c and the directory <= 2c
+            if (t1.size + b1.size() >= c && !b1.empty())
+                drop_ghost(b1);
+            else if (t1.size + t2.size + b1.size() + b2.size() >= 2 * c && !b2.empty())
+                drop_ghost(b2);
+            links.push_back(t1, i);
+            in_t2[i] = false;
+            return;
+        }
+
+        if (g->second.first == 1) {
+            target = std::min(c, target + std::max(1U, (unsigned int) (b2.size() / b1.size())));
+            b1.erase(g->second.second);
+        } else {
+            target -= std::min(target, std::max(1U, (unsigned int) (b1.size() / b2.size())));
+            b2.erase(g->second.second);
+        }
+        ghosts.erase(g);
+        links.push_back(t2, i);
+        in_t2[i] = true;
+    }
+
+    void referenced(unsigned int f)
+    {
+    }
+
+    void remove(unsigned int f)
+    {
+        unsigned int i = f - base;
+        links.remove(in_t2[i] ? t2 : t1, i);
+    }
+
+    void forget(page_key key)
+    {
+        ghost_map::iterator g = ghosts.find(key);
+        if (g != ghosts.end()) {
+            (g->second.first == 1 ? b1 : b2).erase(g->second.second);
+            ghosts.erase(g);
+        }
+    }
+
+    // victim() left a ghost and took the frame off the head of its list
+    void reinstate(unsigned int f)
+    {
+        unsigned int i = f - base;
+        forget(core_map[f].key());
+        frame_list& l = in_t2[i] ? t2 : t1;
+        links.insert_before(l, l.head, i);
+        l.head = i;
+    }
+
+    template <class Keep>
+    unsigned int victim(Keep keep)
+    {
+        for (;;) {
+            count_total(&pager_stats::hand_steps);
+            if (t1.size > 0 && (t1.size >= std::max(1U, target) || t2.size == 0)) {
+                unsigned int i = t1.head;
+                links.remove(t1, i);
+                if (!core_map[base + i].page().reference) {
+                    if (!keep(base + i))
+                        return evict(i, b1, 1);
+                    links.push_back(t1, i);
+                    continue;
+                }
+                clear_reference(base + i);
+                if (fresh[i]) {
+                    fresh[i] = false;
+                    links.push_back(t1, i);
+                } else {
+                    links.push_back(t2, i);
+                    in_t2[i] = true;
+                }
+            } else {
+                unsigned int i = t2.head;
+                links.remove(t2, i);
+                if (!core_map[base + i].page().reference) {
+                    if (!keep(base + i))
+                        return evict(i, b2, 2);
+                    links.push_back(t2, i);
+                    continue;
+                }
+                clear_reference(base + i);
+                fresh[i] = false;
+                links.push_back(t2, i);
+            }
+        }
+    }
+
+private:
+    typedef std::list<page_key> ghost_list;
+    typedef std::unordered_map<page_key, std::pair<int, ghost_list::iterator> > ghost_map;
+
+    unsigned int evict(unsigned int i, ghost_list& ghost, int which)
+    {
+        page_key key = core_map[base + i].key();
+        ghost.push_back(key);
+        ghosts[key] = std::make_pair(which, --ghost.end());
+        return base + i;
+    }
+
+    void drop_ghost(ghost_list& ghost)
+    {
+        ghosts.erase(ghost.front());
+        ghost.pop_front();
+    }
+
+    unsigned int base;
+    unsigned int c;
+    unsigned int target;        // target size of T1
+    frame_links links;          // by frame - base, as are in_t2 and fresh
+    frame_list t1;
+    frame_list t2;
+    ghost_list b1;
+    ghost_list b2;
+    ghost_map ghosts;
+    std::vector<bool> in_t2;
+    std::vector<bool> fresh;
+};
+
+/*
+ * CLOCK-Pro (Jiang, Chen and Zhang).  Resident pages are hot or cold; cold
+ * pages start a test period when they come in, and keep a non-resident
+ * entry on the clock if they are evicted during it.  A cold page re-used
+ * during its test period turns hot, which also grows the cold target, while
+ * test periods that expire unused shrink it.  Three hands share one clock:
+ * the cold hand evicts, the hot hand demotes hot pages once there are too
+ * many, and the test hand bounds the non-resident entries to one memory's
+ * worth.
+ */
+class clockpro_policy {
+public:
+    void init(unsigned int first, unsigned int frames)
+    {
+        base = first;
+        m = frames;
+        cold_target = std::max(1U, frames / 4);
+        if (cold_target >= m && m > 1)
+            cold_target = m - 1;
+        hot_count = cold_count = nonresident_count = 0;
+        hand_hot = hand_cold = hand_test = FRAME_NIL;
+        frame_node.assign(frames, FRAME_NIL);
+        taken_hot.assign(frames, false);
+        taken_test.assign(frames, false);
+        nodes.clear();
+        free_nodes.clear();
+        links.init(0);
+    }
+
+    void insert(unsigned int f)
+    {
+        unsigned int n;
+        page_key key = core_map[f].key();
+        std::unordered_map<page_key, unsigned int>::iterator t = nonresident.find(key);
+        if (t != nonresident.end()) {
+            // re-used during its test period: comes back hot
+            n = t->second;
+            nonresident.erase(t);
+            nonresident_count--;
+            unlink(n);
+            if (cold_target + 1 < m)
+                cold_target++;
+            n = alloc(f, key, true);
+            hot_count++;
+        } else {
+            n = alloc(f, key, false);
+            nodes[n].test = true;
+            cold_count++;
+        }
+        frame_node[f - base] = n;
+        link_at_head(n);
+
+        while (hot_count > m - cold_target && hot_count > 0)
+            run_hand_hot();
+    }
+
+    void referenced(unsigned int f)
+    {
+    }
+
+    void forget(page_key key)
+    {
+        std::unordered_map<page_key, unsigned int>::iterator t = nonresident.find(key);
+        if (t != nonresident.end()) {
+            unsigned int n = t->second;
+            nonresident.erase(t);
+            nonresident_count--;
+            unlink(n);
+            release(n);
+        }
+    }
+
+    void remove(unsigned int f)
+    {
+        unsigned int n = frame_node[f - base];
+        if (nodes[n].hot)
+            hot_count--;
+        else
+            cold_count--;
+        taken_hot[f - base] = nodes[n].hot;
+        taken_test[f - base] = nodes[n].test;
+        frame_node[f - base] = FRAME_NIL;
+        unlink(n);
+        release(n);
+    }
+
+    // a cold page victim() took in its test period is still on the clock,
+    // as a non-resident entry; any other page gets its node back under the
+    // cold hand, which had just passed it
+    void reinstate(unsigned int f)
+    {
+        page_key key = core_map[f].key();
+        unsigned int n;
+        std::unordered_map<page_key, unsigned int>::iterator t = nonresident.find(key);
+        if (t != nonresident.end()) {
+            n = t->second;
+            nonresident.erase(t);
+            nonresident_count--;
+            nodes[n].resident = true;
+            nodes[n].frame = f;
+        } else {
+            n = alloc(f, key, taken_hot[f - base]);
+            nodes[n].test = taken_test[f - base];
+            nodes[n].fresh = false;
+            if (clock.head == FRAME_NIL)
+                link_at_head(n);
+            else
+                links.insert_before(clock, hand_cold, n);
+        }
+        if (nodes[n].hot)
+            hot_count++;
+        else
+            cold_count++;
+        frame_node[f - base] = n;
+        hand_cold = n;
+    }
+
+    template <class Keep>
+    unsigned int victim(Keep keep)
+    {
+        // frames held outside the engine (e.g. during read-ahead) can leave
+        // it with hot pages only
+        if (cold_count == 0)
+            run_hand_hot();
+        for (;;) {
+            count_total(&pager_stats::hand_steps);
+            unsigned int n = hand_cold;
+            node& nd = nodes[n];
+            if (!nd.resident || nd.hot) {
+                hand_cold = links.after(n);
+                continue;
+            }
+
+            unsigned int f = nd.frame;
+            if (core_map[f].page().reference) {
+                clear_reference(f);
+                if (nd.fresh) {
+                    nd.fresh = false;
+                } else if (nd.test) {
+                    nd.hot = true;
+                    cold_count--;
+                    hot_count++;
+                } else {
+                    nd.test = true;
+                }
+                unlink(n);
+                link_at_head(n);
+                while (hot_count > m - cold_target && hot_count > 0)
+                    run_hand_hot();
+                continue;
+            }
+            if (keep(f)) {
+                hand_cold = links.after(n);
+                continue;
+            }
+
+            cold_count--;
+            taken_hot[f - base] = false;
+            taken_test[f - base] = nd.test;
+            frame_node[f - base] = FRAME_NIL;
+            if (nd.test) {
+                // stays on the clock as a non-resident page in test
+                hand_cold = links.after(n);
+                nd.resident = false;
+                nd.frame = FRAME_NIL;
+                nonresident[nd.key] = n;
+                nonresident_count++;
+                while (nonresident_count > m)
+                    run_hand_test();
+            } else {
+                unlink(n);
+                release(n);
+            }
+            return f;
+        }
+    }
+
+private:
+    struct node {
+        unsigned int frame;     // FRAME_NIL once non-resident
+        page_key key;
+        bool hot;
+        bool test;
+        bool resident;
+        bool fresh;
+    };
+
+    unsigned int alloc(unsigned int f, page_key key, bool hot)
+    {
+        unsigned int n;
+        if (free_nodes.empty()) {
+            n = nodes.size();
+            nodes.push_back(node());
+            links.grow(nodes.size());
+        } else {
+            n = free_nodes.back();
+            free_nodes.pop_back();
+        }
+        nodes[n].frame = f;
+        nodes[n].key = key;
+        nodes[n].hot = hot;
+        nodes[n].test = false;
+        nodes[n].resident = true;
+        nodes[n].fresh = true;
+        return n;
+    }
+
+    void release(unsigned int n)
+    {
+        free_nodes.push_back(n);
+    }
+
+    // the list head is just behind the hot hand, the last place it reaches
+    void link_at_head(unsigned int n)
+    {
+        if (clock.head == FRAME_NIL) {
+            links.push_back(clock, n);
+            hand_hot = hand_cold = hand_test = n;
+        } else {
+            links.insert_before(clock, hand_hot, n);
+        }
+    }
+
+    void unlink(unsigned int n)
+    {
+        unsigned int next = links.after(n);
+        if (next == n)
+            next = FRAME_NIL;
+        if (hand_hot == n)
+            hand_hot = next;
+        if (hand_cold == n)
+            hand_cold = next;
+        if (hand_test == n)
+            hand_test = next;
+        links.remove(clock, n);
+    }
+
+    // demote one hot page to cold
+    void run_hand_hot()
+    {
+        for (;;) {
+            unsigned int n = hand_hot;
+            node& nd = nodes[n];
+            if (!nd.resident) {
+                // its test period is over
+                nonresident.erase(nd.key);
+                nonresident_count--;
+                unlink(n);
+                release(n);
+                if (cold_target > 1)
+                    cold_target--;
+                continue;
+            }
+            hand_hot = links.after(n);
+            if (!nd.hot) {
+                nd.test = false;
+            } else if (core_map[nd.frame].page().reference) {
+                clear_reference(nd.frame);
+                nd.fresh = false;
+            } else {
+                nd.hot = false;
+                nd.test = false;
+                hot_count--;
+                cold_count++;
+                return;
+            }
+        }
+    }
+
+    // drop one non-resident page
+    void run_hand_test()
+    {
+        for (;;) {
+            unsigned int n = hand_test;
+            node& nd = nodes[n];
+            if (!nd.resident) {
+                nonresident.erase(nd.key);
+                nonresident_count--;
+                unlink(n);
+                release(n);
+                if (cold_target > 1)
+                    cold_target--;
+                return;
+            }
+            if (!nd.hot)
+                nd.test = false;
+            hand_test = links.after(n);
+        }
+    }
+
+    unsigned int base;
+    unsigned int m;
+    unsigned int cold_target;
+    unsigned int hot_count;
+    unsigned int cold_count;
+    unsigned int nonresident_count;
+    unsigned int hand_hot;
+    unsigned int hand_cold;
+    unsigned int hand_test;
+    frame_list clock;
+    frame_links links;
+    std::vector<node> nodes;
+    std::vector<unsigned int> free_nodes;
+    std::vector<unsigned int> frame_node;         // by frame - base
+    std::vector<bool> taken_hot;                  // by frame - base: the state
+    std::vector<bool> taken_test;                 // of a taken page's node
+    std::unordered_map<page_key, unsigned int> nonresident;
+};
+
+/*
+ * LRU-K with K = 2 (O'Neil, O'Neil and Weikum): evict the page whose second
+ * most recent reference is oldest; pages referenced only once go first, in
+ * order of that reference.  The last reference of an evicted page is
+ * retained for one memory's worth of evictions, so a page that comes back
+ * soon keeps its history.  References are seen as faults, so every eviction
+ * also re-arms the reference bits of a few frames ahead of a sampling hand,
+ * and the next access to those pages is observed.  Time is virtual: it
+ * advances by one on every fault.
+ */
+class lruk_policy {
+public:
+    void init(unsigned int first, unsigned int frames)
+    {
+        base = first;
+        n = frames;
+        last.assign(frames, 0);
+        second_last.assign(frames, 0);
+        order.clear();
+        sample_hand = first;
+        now = 0;
+    }
+
+    void insert(unsigned int f)
+    {
+        now++;
+        second_last[f - base] = 0;
+        history_map::iterator h = history.find(core_map[f].key());
+        if (h != history.end()) {
+            second_last[f - base] = h->second.first;
+            retained.erase(h->second.second);
+            history.erase(h);
+        }
+        last[f - base] = now;
+        order.insert(order_key(f));
+    }
+
+    void referenced(unsigned int f)
+    {
+        now++;
+        order.erase(order_key(f));
+        second_last[f - base] = last[f - base];
+        last[f - base] = now;
+        order.insert(order_key(f));
+    }
+
+    void remove(unsigned int f)
+    {
+        order.erase(order_key(f));
+    }
+
+    void forget(page_key key)
+    {
+        history_map::iterator h = history.find(key);
+        if (h != history.end()) {
+            retained.erase(h->second.second);
+            history.erase(h);
+        }
+    }
+
+    // victim() retained the page's history; its references are still in
+    // last and second_last
+    void reinstate(unsigned int f)
+    {
+        forget(core_map[f].key());
+        order.insert(order_key(f));
+    }
+
+    template <class Keep>
+    unsigned int victim(Keep keep)
+    {
+        for (unsigned int i = 0; i < SAMPLE_FRAMES; i++) {
+            count_total(&pager_stats::hand_steps);
+            if (core_map[sample_hand].proc != NULL && core_map[sample_hand].page().reference)
+                clear_reference(sample_hand);
+            if (++sample_hand == base + n)
+                sample_hand = base;
+        }
+
+        assert(!order.empty());
+        std::set<order_t>::iterator o = order.begin();
+        while (keep(o->second)) {
+            count_total(&pager_stats::hand_steps);
+            ++o;
+            assert(o != order.end());
+        }
+        unsigned int f = o->second;
+        order.erase(o);
+
+        page_key key = core_map[f].key();
+        if (retained.size() >= n) {
+            history.erase(retained.front());
+            retained.pop_front();
+        }
+        retained.push_back(key);
+        history[key] = std::make_pair(last[f - base], --retained.end());
+        return f;
+    }
+
+private:
+    static const unsigned int SAMPLE_FRAMES = 2;
+
+    typedef std::pair<std::pair<unsigned long long, unsigned long long>, unsigned int> order_t;
+    typedef std::list<page_key> retained_list;
+    typedef std::unordered_map<page_key, std::pair<unsigned long long, retained_list::iterator> > history_map;
+
+    order_t order_key(unsigned int f) const
+    {
+        return std::make_pair(std::make_pair(second_last[f - base], last[f - base]), f);
+    }
+
+    unsigned int base;
+    unsigned int n;
+    std::vector<unsigned long long> last;             // by frame - base
+    std::vector<unsigned long long> second_last;
+    std::set<order_t> order;
+    retained_list retained;     // evicted pages, oldest first
+    history_map history;        // last reference of each retained page
+    unsigned int sample_hand;
+    unsigned long long now;
+};
+
+#endif /* _REPLACE_H_ */
@@ -0,0 +1,207 @@
+/*
+ * replay.cc
+ *
+ * Replay a trace recorded with "-t trace_file" straight into the pager,
+ * through the simulator's software MMU, and report what the pager did.
+ *
+ * By default each recorded fault is replayed as the access that caused it:
+ * the pager only sees a fault if its own page table does not allow the
+ * access, so pager changes can be compared on identical inputs.  With -f the
+ * recorded faults are passed to vm_fault as they are.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <iostream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "vm_pager.h"
+#include "vm_sim.h"
+#include "pager.h"
+#include "trace.h"
+
+using namespace std;
+
+static void Usage()
+{
+    cerr << "Usage: replay [-m memory_pages] [-d disk_blocks] [-p policy] [-w clean_low] [-k dedup_pages] [-z zcache_frames] [-o overcommit] [-s stats_format] [-e events_file] [-f] [-q] trace_file" << endl;
+    exit(1);
+}
+
+static double now_sec()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(int argc, char **argv)
+{
+    unsigned long memory_pages = 0;
+    unsigned long disk_blocks = 0;
+    bool raw_faults = false;
+    bool quiet = false;
+
+    int c;
+    while ((c = getopt(argc, argv, "m:d:p:w:k:z:o:s:e:fq")) != -1) {
+        switch (c) {
+        case 'm':
+            memory_pages = strtoul(optarg, NULL, 0);
+            break;
+        case 'd':
+            disk_blocks = strtoul(optarg, NULL, 0);
+            break;
+        case 'p':
+            pager_policy = optarg;
+            break;
+        case 'w':
+            pager_clean_low = strtoul(optarg, NULL, 0);
+            break;
+        case 'k':
+            pager_dedup_pages = strtoul(optarg, NULL, 0);
+            break;
+        case 'z':
+            pager_zcache_frames = strtoul(optarg, NULL, 0);
+            break;
+        case 'o':
+            pager_overcommit = optarg;
+            break;
+        case 's':
+            pager_stats_format = optarg;
+            break;
+        case 'e':
+            pager_events = optarg;
+            break;
+        case 'f':
+            raw_faults = true;
+            break;
+        case 'q':
+            quiet = true;
+            break;
+        default:
+            Usage();
+        }
+    }
+    if (optind != argc - 1)
+        Usage();
+
+    const char *path = argv[optind];
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        perror(path);
+        exit(1);
+    }
+    if ((size_t) st.st_size < sizeof(trace_header)) {
+        cerr << path << ": not a trace" << endl;
+        exit(1);
+    }
+    char *data = (char *) mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+        perror(path);
+        exit(1);
+    }
+    close(fd);
+
+    const trace_header *h = (const trace_header *) data;
+    if (strcmp(h->magic, TRACE_MAGIC) != 0 || h->version != TRACE_VERSION) {
+        cerr << path << ": not a version " << TRACE_VERSION << " trace" << endl;
+        exit(1);
+    }
+    if (memory_pages == 0)
+        memory_pages = h->memory_pages;
+    if (disk_blocks == 0)
+        disk_blocks = h->disk_blocks;
+
+    const trace_record *records = (const trace_record *) (data + sizeof(trace_header));
+    size_t count = (st.st_size - sizeof(trace_header)) / sizeof(trace_record);
+
+    pm_init(memory_pages);
+    disk_init(disk_blocks);
+    vm_init(memory_pages, disk_blocks);
+    if (quiet)
+        cout.setstate(ios::badbit);
+
+    unsigned long long faults = 0;
+    unsigned long long refused = 0;
+    double start = now_sec();
+
+    for (size_t i = 0; i < count; i++) {
+        const trace_record &r = records[i];
+        void *addr = (char *) VM_ARENA_BASEADDR + r.addr;
+        char name[32];
+
+        switch (r.op) {
+        case TRACE_CREATE:
+            vm_create(r.pid);
+            break;
+        case TRACE_SWITCH:
+            vm_switch(r.pid);
+            break;
+        case TRACE_EXTEND:
+            vm_extend();
+            break;
+        case TRACE_EXTEND_N:
+            vm_extend_n(r.len);
+            break;
+        case TRACE_FAULT:
+            if (raw_faults) {
+                faults++;
+                if (vm_fault(addr, r.flag))
+                    refused++;
+            } else if (mmu_translate(addr, r.flag) == NULL) {
+                refused++;
+            }
+            break;
+        case TRACE_SYSLOG:
+            vm_syslog(addr, r.len);
+            break;
+        case TRACE_RELEASE:
+            vm_release(addr, r.len);
+            break;
+        case TRACE_ADVISE:
+            vm_advise(addr, r.len, r.flag);
+            break;
+        case TRACE_DESTROY:
+            vm_destroy();
+            break;
+        case TRACE_FORK:
+            vm_fork(r.len);
+            break;
+        case TRACE_SHM_ATTACH:
+            trace_shm_name(r.len, name, sizeof(name));
+            vm_shm_attach(name, r.addr);
+            break;
+        case TRACE_SHM_UNLINK:
+            trace_shm_name(r.len, name, sizeof(name));
+            vm_shm_unlink(name);
+            break;
+        default:
+            cerr << path << ": bad record " << i << " (op " << (int) r.op << ")" << endl;
+            exit(1);
+        }
+    }
+
+    double elapsed = now_sec() - start;
+    if (!raw_faults)
+        faults = mmu_faults;
+
+    cout.clear();
+    cout << "memory_pages " << memory_pages << "\tdisk_blocks " << disk_blocks
+         << "\trecords " << count << endl;
+    cout << "faults " << faults << "\trefused " << refused
+         << "\tfaults/sec " << (elapsed > 0 ? faults / elapsed : 0.0)
+         << "\telapsed_ms " << elapsed * 1e3 << endl;
+    cout << "disk_read " << disk_reads << "\tdisk_write " << disk_writes
+         << "\tdisk_requests " << disk_requests << endl;
+    pager_dump_stats(cout, false);
+    swap_usage swap = pager_swap_usage();
+    cout << "swap_free " << swap.free_blocks << "\tswap_extents " << swap.extents
+         << "\tswap_largest_extent " << swap.largest_extent << endl;
+    pager_shutdown();
+    return 0;
+}
@@ -0,0 +1,194 @@
+/*
+ * state_file.h
+ *
+ * The pager's swap metadata kept in a file mapped into memory, so that a
+ * pager started after this one can find the pages processes wrote to disk
+ * (see pager_state in pager.h).  The file is a header page followed by
+ * process slots: the slot's process, then one 32-bit record per arena
+ * page, holding the page's disk block plus one (0 for none) and
+ * STATE_RESIDENT while the page is resident.  The pager updates a record
+ * with a plain store whenever it changes, so the file is always current,
+ * as of the last store, without ever being written out as a whole.  The
+ * free disk blocks, and the blocks shared by forked processes, follow from
+ * the records and are not stored.  The file is sparse: only the records of
+ * pages in use take room.
+ */
+
+#ifndef _STATE_FILE_H_
+#define _STATE_FILE_H_
+
+#include <stdint.h>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+#include "vm_pager.h"
+
+#define STATE_MAGIC     "VMSTATE"
+#define STATE_VERSION   1
+// slots of a new file; the file doubles when they run out
+#define STATE_SLOTS     64
+// bytes of a slot before its records
+#define STATE_SLOT_HEAD 64
+
+#define STATE_NONE      0U              // record of a page without a block
+#define STATE_RESIDENT  0x80000000U
+
+/* state_slot of a process the file does not hold (a shared segment) */
+#define NO_SLOT (~0U)
+
+struct state_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t page_size;     // VM_PAGESIZE
+    uint32_t arena_pages;   // records per slot
+    uint32_t disk_blocks;
+    uint32_t slots;
+    uint32_t restarts;      // pagers that resumed from the file
+};
+
+struct state_slot {
+    uint32_t live;          // set while the slot holds a process
+    int32_t pid;
+    uint32_t pages;         // valid pages of the arena
+    uint32_t unused;
+    int64_t swap_base;
+};
+
+class state_file {
+public:
+    state_file() : base(NULL), size(0), fd(-1)
+    {
+    }
+
+    /*
+     * Map the state file "path" of a pager with "disk_blocks" disk blocks,
+     * creating it if it does not exist or is empty.  Returns NULL, or why
+     * the file cannot be used.
+     */
+    const char* open(const char* path, unsigned int disk_blocks)
+    {
+        fd = ::open(path, O_RDWR | O_CREAT, 0600);
+        struct stat st;
+        if (fd < 0 || fstat(fd, &st) != 0)
+            return "cannot open it";
+        bool fresh = st.st_size == 0;
+        if (fresh) {
+            if (ftruncate(fd, file_size(STATE_SLOTS)) != 0)
+                return "cannot size it";
+        } else if ((size_t) st.st_size < sizeof(state_header)) {
+            return "not a state file";
+        }
+        size = fresh ? file_size(STATE_SLOTS) : st.st_size;
+        void* p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (p == MAP_FAILED)
+            return "cannot map it";
+        base = (char*) p;
+
+        state_header& h = header();
+        if (fresh) {
+            memcpy(h.magic, STATE_MAGIC, sizeof(h.magic));
+            h.version = STATE_VERSION;
+            h.page_size = VM_PAGESIZE;
+            h.arena_pages = VM_ARENA_SIZE / VM_PAGESIZE;
+            h.disk_blocks = disk_blocks;
+            h.slots = STATE_SLOTS;
+        }
+        if (memcmp(h.magic, STATE_MAGIC, sizeof(h.magic)) != 0)
+            return "not a state file";
+        if (h.version != STATE_VERSION)
+            return "written by another version of the pager";
+        if (h.page_size != VM_PAGESIZE || h.arena_pages != VM_ARENA_SIZE / VM_PAGESIZE)
+            return "written for another page or arena size";
+        if (h.disk_blocks != disk_blocks)
+            return "written for a disk of another size";
+        if (size < file_size(h.slots))
+            return "truncated";
+        free_slots.clear();
+        for (unsigned int i = h.slots; i-- > 0; )
+            if (!slot(i).live)
+                free_slots.push_back(i);
+        return NULL;
+    }
+
+    bool mapped() const
+    {
+        return base != NULL;
+    }
+
+    state_header& header()
+    {
+        return *(state_header*) base;
+    }
+
+    state_slot& slot(unsigned int i)
+    {
+        return *(state_slot*) (base + slot_offset(i));
+    }
+
+    uint32_t* records(unsigned int i)
+    {
+        return (uint32_t*) (base + slot_offset(i) + STATE_SLOT_HEAD);
+    }
+
+    // a free slot, the last one freed first; the file doubles when there
+    // is none.  NO_SLOT if it cannot.
+    unsigned int alloc_slot()
+    {
+        if (free_slots.empty()) {
+            unsigned int slots = header().slots;
+            size_t grown = file_size(2 * slots);
+            if (ftruncate(fd, grown) != 0)
+                return NO_SLOT;
+            void* p = mremap(base, size, grown, MREMAP_MAYMOVE);
+            if (p == MAP_FAILED)
+                return NO_SLOT;
+            base = (char*) p;
+            size = grown;
+            header().slots = 2 * slots;
+            for (unsigned int i = 2 * slots; i-- > slots; )
+                free_slots.push_back(i);
+        }
+        unsigned int i = free_slots.back();
+        free_slots.pop_back();
+        return i;
+    }
+
+    void free_slot(unsigned int i)
+    {
+        slot(i).live = 0;
+        free_slots.push_back(i);
+    }
+
+    // flush the mapping to the file
+    bool sync()
+    {
+        return msync(base, size, MS_SYNC) == 0;
+    }
+
+private:
+    // (a whole number of pages, so a small process takes one page)
+    static size_t slot_size()
+    {
+        return VM_PAGESIZE + (size_t) (VM_ARENA_SIZE / VM_PAGESIZE) * sizeof(uint32_t);
+    }
+
+    static size_t slot_offset(unsigned int i)
+    {
+        return VM_PAGESIZE + (size_t) i * slot_size();
+    }
+
+    static size_t file_size(unsigned int slots)
+    {
+        return slot_offset(slots);
+    }
+
+    char* base;
+    size_t size;
+    int fd;
+    std::vector<unsigned int> free_slots;   // next to use at the back
+};
+
+#endif /* _STATE_FILE_H_ */
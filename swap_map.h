@@ -0,0 +1,132 @@
+/*
+ * swap_map.h
+ *
+ * Free disk blocks of the pager, kept as extents (runs of consecutive free
+ * blocks) so that a block can be taken at a chosen position and freed
+ * blocks merge back with their neighbours.  The extents are indexed both by
+ * start block, to take or free a given block, and by length, to find the
+ * largest hole.  All operations are O(log extents).
+ */
+
+#ifndef _SWAP_MAP_H_
+#define _SWAP_MAP_H_
+
+#include <cassert>
+#include <map>
+#include <set>
+#include <utility>
+
+class swap_map {
+public:
+    void init(unsigned int blocks)
+    {
+        by_start.clear();
+        by_length.clear();
+        if (blocks > 0)
+            add(0, blocks);
+        free_count = blocks;
+    }
+
+    unsigned int free_blocks() const
+    {
+        return free_count;
+    }
+
+    unsigned int extents() const
+    {
+        return by_start.size();
+    }
+
+    bool is_free(unsigned int block) const
+    {
+        extent_map::const_iterator e = containing(block);
+        return e != by_start.end();
+    }
+
+    // the largest free extent, as (start, length); length 0 if the disk is full
+    std::pair<unsigned int, unsigned int> largest() const
+    {
+        if (by_length.empty())
+            return std::make_pair(0U, 0U);
+        return std::make_pair(by_length.rbegin()->second, by_length.rbegin()->first);
+    }
+
+    // take the free block "block" out of its extent
+    void take(unsigned int block)
+    {
+        extent_map::iterator e = containing(block);
+        assert(e != by_start.end());
+        unsigned int start = e->first;
+        unsigned int length = e->second;
+        erase(e);
+        if (block > start)
+            add(start, block - start);
+        if (block + 1 < start + length)
+            add(block + 1, start + length - block - 1);
+        free_count--;
+    }
+
+    // return a block, merging it with the free extents around it
+    void release(unsigned int block)
+    {
+        unsigned int start = block;
+        unsigned int length = 1;
+
+        extent_map::iterator next = by_start.upper_bound(block);
+        if (next != by_start.begin()) {
+            extent_map::iterator prev = next;
+            --prev;
+            assert(prev->first + prev->second <= block);
+            if (prev->first + prev->second == block) {
+                start = prev->first;
+                length += prev->second;
+                erase(prev);
+            }
+        }
+        if (next != by_start.end() && next->first == block + 1) {
+            length += next->second;
+            erase(next);
+        }
+        add(start, length);
+        free_count++;
+    }
+
+private:
+    typedef std::map<unsigned int, unsigned int> extent_map;     // start -> length
+
+    extent_map::const_iterator containing(unsigned int block) const
+    {
+        extent_map::const_iterator e = by_start.upper_bound(block);
+        if (e == by_start.begin())
+            return by_start.end();
+        --e;
+        return block < e->first + e->second ? e : by_start.end();
+    }
+
+    extent_map::iterator containing(unsigned int block)
+    {
+        extent_map::iterator e = by_start.upper_bound(block);
+        if (e == by_start.begin())
+            return by_start.end();
+        --e;
+        return block < e->first + e->second ? e : by_start.end();
+    }
+
+    void add(unsigned int start, unsigned int length)
+    {
+        by_start[start] = length;
+        by_length.insert(std::make_pair(length, start));
+    }
+
+    void erase(extent_map::iterator e)
+    {
+        by_length.erase(std::make_pair(e->second, e->first));
+        by_start.erase(e);
+    }
+
+    extent_map by_start;
+    std::set<std::pair<unsigned int, unsigned int> > by_length;    // (length, start)
+    unsigned int free_count;
+};
+
+#endif /* _SWAP_MAP_H_ */
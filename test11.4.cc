@@ -0,0 +1,44 @@
+#include <iostream>
+#include "vm_app.h"
+
+using namespace std;
+
+// the copies of the app pass messages through a shared segment: each takes
+// the next slot, writes its message there and yields, and once every copy
+// has had a turn reads all of them
+int main(){
+	char *shared = (char *) vm_shm_attach("test11", 3);
+	char *own = (char *) vm_extend();
+	if(shared == NULL || own == NULL || vm_shm_attach("test11", 2) != NULL){
+		cout << "Fail" << endl;
+		return -1;
+	}
+
+	int slot = shared[0]++;
+	char *msg = shared + VM_PAGESIZE + slot * 16;
+	const char hello[] = "hello from 0";
+	for(unsigned int i = 0; i < sizeof(hello); i++){
+		msg[i] = hello[i];
+		own[i] = hello[i];
+	}
+	msg[11] += slot;
+	shared[2 * VM_PAGESIZE + slot] = 1;
+
+	vm_yield();
+
+	int copies = shared[0];
+	for(int i = 0; i < copies; i++){
+		char *other = shared + VM_PAGESIZE + i * 16;
+		if(other[11] != '0' + i || shared[2 * VM_PAGESIZE + i] != 1){
+			cout << "Fail" << endl;
+			return -1;
+		}
+		vm_syslog(other, 12);
+	}
+	// the segment stays until the last copy exits
+	if(slot == 0 && vm_shm_unlink("test11") != 0){
+		cout << "Fail" << endl;
+		return -1;
+	}
+	vm_syslog(own, 10);
+}
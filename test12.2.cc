@@ -0,0 +1,37 @@
+#include <iostream>
+#include "vm_app.h"
+
+using namespace std;
+
+// vm_extend_n grows the arena by several pages in one call, or not at all
+int main(){
+	if(vm_extend_n(0) != NULL){
+		cout << "Fail" << endl;
+		return -1;
+	}
+
+	char *base = (char *) vm_extend_n(4);
+	char *next = (char *) vm_extend();
+	if(base == NULL || next != base + 4 * VM_PAGESIZE){
+		cout << "Fail" << endl;
+		return -1;
+	}
+
+	// more pages than the arena holds, or than the disk has swap for
+	if(vm_extend_n(1 << 16) != NULL || vm_extend_n(60000) != NULL
+			|| (char *) vm_extend() != base + 5 * VM_PAGESIZE){
+		cout << "Fail" << endl;
+		return -1;
+	}
+
+	const char msg[] = "spans pages";
+	for(int i = 0; i < 5; i++){
+		char *p = base + i * VM_PAGESIZE + VM_PAGESIZE - 5;
+		for(unsigned int j = 0; j < sizeof(msg) - 1; j++)
+			p[j] = msg[j];
+	}
+	for(int i = 0; i < 5; i++)
+		vm_syslog(base + i * VM_PAGESIZE + VM_PAGESIZE - 5, sizeof(msg) - 1);
+
+	cout << "Success" << endl;
+}
@@ -0,0 +1,63 @@
+#include <iostream>
+#include "vm_app.h"
+
+using namespace std;
+
+static char *arena;
+
+// page i holds 'A' + i in its first and last bytes, or zeros if released
+static bool check(int i, bool released){
+	char want = released ? 0 : 'A' + i;
+	char *page = arena + i * VM_PAGESIZE;
+	return page[0] == want && page[VM_PAGESIZE - 1] == want;
+}
+
+static bool check_all(){
+	for(int i = 0; i < 12; i++){
+		if(!check(i, i == 3 || i == 4))
+			return false;
+	}
+	return true;
+}
+
+// vm_release drops whole pages only, which then read as zeros; vm_advise
+// hints change nothing the app can see
+int main(){
+	arena = (char *) vm_extend_n(12);
+	if(arena == NULL){
+		cout << "Fail" << endl;
+		return -1;
+	}
+	for(int i = 0; i < 12; i++){
+		arena[i * VM_PAGESIZE] = 'A' + i;
+		arena[i * VM_PAGESIZE + VM_PAGESIZE - 1] = 'A' + i;
+	}
+
+	// pages 3 and 4 lie wholly in the range, 2 and 5 only in part
+	if(vm_release(arena + 2 * VM_PAGESIZE + 100, 3 * VM_PAGESIZE) != 0
+			|| vm_release(arena + 100, 10) != 0 || !check_all()){
+		cout << "Fail" << endl;
+		return -1;
+	}
+	if(vm_release(arena, 13 * VM_PAGESIZE) != -1 || vm_release(arena, 0) != -1
+			|| vm_advise(arena, VM_PAGESIZE, 99) != -1
+			|| vm_advise(arena + 12 * VM_PAGESIZE, 1, VM_ADVISE_NORMAL) != -1){
+		cout << "Fail" << endl;
+		return -1;
+	}
+
+	if(vm_advise(arena, 12 * VM_PAGESIZE, VM_ADVISE_SEQUENTIAL) != 0 || !check_all()
+			|| vm_advise(arena + 6 * VM_PAGESIZE, 6 * VM_PAGESIZE, VM_ADVISE_WILLNEED) != 0
+			|| !check_all()
+			|| vm_advise(arena, 6 * VM_PAGESIZE, VM_ADVISE_DONTNEED) != 0
+			|| vm_advise(arena, 12 * VM_PAGESIZE, VM_ADVISE_RANDOM) != 0 || !check_all()){
+		cout << "Fail" << endl;
+		return -1;
+	}
+
+	// a released page comes back with the next write
+	arena[3 * VM_PAGESIZE + 1] = 'x';
+	vm_syslog(arena + 3 * VM_PAGESIZE + 1, 1);
+	vm_syslog(arena + 5 * VM_PAGESIZE, 1);
+	cout << "Success" << endl;
+}
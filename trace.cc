@@ -0,0 +1,153 @@
+/*
+ * trace.cc
+ *
+ * Trace recording for the pager entry points.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "vm_pager.h"
+#include "trace.h"
+
+static FILE *trace_file;
+static pid_t trace_pid;         // process the pager is switched to
+
+void trace_open(const char *path, unsigned int memory_pages, unsigned int disk_blocks)
+{
+    trace_file = fopen(path, "wb");
+    if (trace_file == NULL) {
+        perror(path);
+        exit(1);
+    }
+    setvbuf(trace_file, NULL, _IOFBF, 1 << 20);
+
+    trace_header h;
+    memset(&h, 0, sizeof(h));
+    strcpy(h.magic, TRACE_MAGIC);
+    h.version = TRACE_VERSION;
+    h.memory_pages = memory_pages;
+    h.disk_blocks = disk_blocks;
+    fwrite(&h, sizeof(h), 1, trace_file);
+}
+
+void trace_close()
+{
+    if (trace_file == NULL)
+        return;
+    if (fclose(trace_file) != 0)
+        perror("trace_close");
+    trace_file = NULL;
+}
+
+static void record(trace_op op, pid_t pid, void *addr, unsigned int len, uint8_t flag)
+{
+    trace_record r;
+    r.op = op;
+    r.flag = flag;
+    r.reserved = 0;
+    r.pid = pid;
+    r.addr = (uint32_t) ((unsigned long long) addr - (unsigned long long) VM_ARENA_BASEADDR);
+    r.len = len;
+    fwrite(&r, sizeof(r), 1, trace_file);
+}
+
+void trace_vm_create(pid_t pid)
+{
+    if (trace_file)
+        record(TRACE_CREATE, pid, VM_ARENA_BASEADDR, 0, false);
+    vm_create(pid);
+}
+
+void trace_vm_switch(pid_t pid)
+{
+    if (trace_file)
+        record(TRACE_SWITCH, pid, VM_ARENA_BASEADDR, 0, false);
+    trace_pid = pid;
+    vm_switch(pid);
+}
+
+void *trace_vm_extend()
+{
+    if (trace_file)
+        record(TRACE_EXTEND, trace_pid, VM_ARENA_BASEADDR, 0, false);
+    return vm_extend();
+}
+
+void *trace_vm_extend_n(unsigned int count)
+{
+    if (trace_file)
+        record(TRACE_EXTEND_N, trace_pid, VM_ARENA_BASEADDR, count, false);
+    return vm_extend_n(count);
+}
+
+int trace_vm_fault(void *addr, bool write_flag)
+{
+    if (trace_file)
+        record(TRACE_FAULT, trace_pid, addr, 0, write_flag);
+    return vm_fault(addr, write_flag);
+}
+
+int trace_vm_syslog(void *message, unsigned int len)
+{
+    if (trace_file)
+        record(TRACE_SYSLOG, trace_pid, message, len, false);
+    return vm_syslog(message, len);
+}
+
+int trace_vm_release(void *addr, unsigned int len)
+{
+    if (trace_file)
+        record(TRACE_RELEASE, trace_pid, addr, len, false);
+    return vm_release(addr, len);
+}
+
+int trace_vm_advise(void *addr, unsigned int len, int hint)
+{
+    if (trace_file)
+        record(TRACE_ADVISE, trace_pid, addr, len, hint >= 0 && hint < 255 ? hint : 255);
+    return vm_advise(addr, len, hint);
+}
+
+int trace_vm_fork(pid_t pid)
+{
+    if (trace_file)
+        record(TRACE_FORK, trace_pid, VM_ARENA_BASEADDR, pid, false);
+    return vm_fork(pid);
+}
+
+// FNV-1a
+uint32_t trace_shm_hash(const char *name)
+{
+    uint32_t h = 2166136261u;
+    for (; *name != '\0'; name++)
+        h = (h ^ (unsigned char) *name) * 16777619u;
+    return h;
+}
+
+void trace_shm_name(uint32_t hash, char *name, size_t size)
+{
+    snprintf(name, size, "shm.%08x", hash);
+}
+
+void *trace_vm_shm_attach(const char *name, unsigned int pages)
+{
+    if (trace_file)
+        record(TRACE_SHM_ATTACH, trace_pid, (char *) VM_ARENA_BASEADDR + pages,
+                trace_shm_hash(name), false);
+    return vm_shm_attach(name, pages);
+}
+
+int trace_vm_shm_unlink(const char *name)
+{
+    if (trace_file)
+        record(TRACE_SHM_UNLINK, trace_pid, VM_ARENA_BASEADDR, trace_shm_hash(name), false);
+    return vm_shm_unlink(name);
+}
+
+void trace_vm_destroy()
+{
+    if (trace_file)
+        record(TRACE_DESTROY, trace_pid, VM_ARENA_BASEADDR, 0, false);
+    vm_destroy();
+}
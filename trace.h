@@ -0,0 +1,92 @@
+/*
+ * trace.h
+ *
+ * Binary traces of the calls made into the pager.  The trace_vm_* wrappers
+ * forward to the vm_pager.h entry point of the same name and, while a trace
+ * is open, append a record of the call.  replay.cc feeds a trace back into
+ * the pager without the app that produced it.
+ */
+
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#define TRACE_MAGIC   "VMTRACE"
+#define TRACE_VERSION 1
+
+enum trace_op {
+    TRACE_CREATE = 1,   // pid
+    TRACE_SWITCH,       // pid
+    TRACE_EXTEND,       // pid
+    TRACE_FAULT,        // pid, addr, flag = write_flag
+    TRACE_SYSLOG,       // pid, addr, len
+    TRACE_DESTROY,      // pid
+    TRACE_FORK,         // pid, len = child's pid
+    TRACE_SHM_ATTACH,   // pid, addr = pages, len = name (see trace_shm_name)
+    TRACE_SHM_UNLINK,   // pid, len = name
+    TRACE_EXTEND_N,     // pid, len = count
+    TRACE_RELEASE,      // pid, addr, len
+    TRACE_ADVISE,       // pid, addr, len, flag = hint
+};
+
+/*
+ * Traces have no room for strings, so segments are recorded by a hash of
+ * their names, and replayed under the name trace_shm_name gives the hash.
+ */
+extern uint32_t trace_shm_hash(const char *name);
+extern void trace_shm_name(uint32_t hash, char *name, size_t size);
+
+/*
+ * A trace is a trace_header followed by trace_records, in host byte order.
+ * Addresses are stored as offsets from VM_ARENA_BASEADDR.
+ */
+struct trace_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t memory_pages;
+    uint32_t disk_blocks;
+    uint32_t reserved;
+};
+
+struct trace_record {
+    uint8_t op;
+    uint8_t flag;
+    uint16_t reserved;
+    uint32_t pid;
+    uint32_t addr;
+    uint32_t len;
+};
+
+/*
+ * trace_open
+ *
+ * Start recording to "path".  The sizes passed to vm_init are stored in the
+ * header so the trace can be replayed with the same configuration.
+ */
+extern void trace_open(const char *path, unsigned int memory_pages, unsigned int disk_blocks);
+
+/*
+ * trace_close
+ *
+ * Flush and close the trace, if one is open.
+ */
+extern void trace_close();
+
+/* recording wrappers for the vm_pager.h entry points */
+extern void trace_vm_create(pid_t pid);
+extern void trace_vm_switch(pid_t pid);
+extern void *trace_vm_extend();
+extern void *trace_vm_extend_n(unsigned int count);
+extern int trace_vm_fault(void *addr, bool write_flag);
+extern int trace_vm_syslog(void *message, unsigned int len);
+extern int trace_vm_release(void *addr, unsigned int len);
+extern int trace_vm_advise(void *addr, unsigned int len, int hint);
+extern void trace_vm_destroy();
+extern int trace_vm_fork(pid_t pid);
+extern void *trace_vm_shm_attach(const char *name, unsigned int pages);
+extern int trace_vm_shm_unlink(const char *name);
+
+#endif /* _TRACE_H_ */
@@ -0,0 +1,18 @@
+/*
+ * vm_advise.h
+ *
+ * Hints for vm_advise, shared by the app (vm_app.h) and pager (vm_pager.h)
+ * sides of the interface.  The first three set how pages are accessed from
+ * now on, the last two act once.
+ */
+
+#ifndef _VM_ADVISE_H_
+#define _VM_ADVISE_H_
+
+#define VM_ADVISE_NORMAL     0  /* no particular pattern (the default) */
+#define VM_ADVISE_SEQUENTIAL 1  /* read in order, each page once */
+#define VM_ADVISE_RANDOM     2  /* read in no order: read nothing ahead */
+#define VM_ADVISE_WILLNEED   3  /* read the pages in now */
+#define VM_ADVISE_DONTNEED   4  /* evict the pages first, keeping them */
+
+#endif /* _VM_ADVISE_H_ */
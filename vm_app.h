@@ -7,6 +7,24 @@
 #ifndef _VM_APP_H_
 #define _VM_APP_H_
 
+#include "vm_advise.h"
+
+#ifdef VM_SIM
+/*
+ * The in-process simulator links apps into the same binary as the pager,
+ * whose vm_extend and vm_syslog have the same signatures, so the app side of
+ * the interface is renamed.  (The app's main is renamed to vm_app_main when
+ * the app is linked, see the Makefile.)
+ */
+#define vm_extend vm_app_extend
+#define vm_extend_n vm_app_extend_n
+#define vm_syslog vm_app_syslog
+#define vm_shm_attach vm_app_shm_attach
+#define vm_shm_unlink vm_app_shm_unlink
+#define vm_release vm_app_release
+#define vm_advise vm_app_advise
+#endif
+
 /*
  * vm_extend() -- ask for the lowest invalid virtual page in the process's
  * arena to be declared valid.  Returns the lowest-numbered byte of the new
@@ -17,6 +35,53 @@
  */
 extern void *vm_extend(void);
 
+/*
+ * vm_extend_n() -- ask for the lowest "count" invalid virtual pages in the
+ * process's arena to be declared valid, in one call.  Returns the
+ * lowest-numbered byte of the first of them, or NULL, with no page added,
+ * if count is 0, the pages do not fit in the arena or the disk is out of
+ * swap space for all of them.
+ */
+extern void *vm_extend_n(unsigned int count);
+
+/*
+ * vm_shm_attach() -- map the shared segment "name", of "pages" pages, just
+ * above the valid part of the process's arena, creating it (zero-filled) if
+ * no process has yet.  Every process that attaches the segment sees the
+ * same bytes.  Returns the lowest-numbered byte of the segment in the
+ * arena, or NULL if the disk is out of swap space for a new segment or the
+ * segment exists with another size.
+ */
+extern void *vm_shm_attach(const char *name, unsigned int pages);
+
+/*
+ * vm_shm_unlink() -- remove the name of shared segment "name", so that the
+ * next vm_shm_attach of it creates a new segment.  Processes attached to
+ * the old segment keep it until they exit.  Returns 0 on success, -1 if
+ * there is no segment by that name.
+ */
+extern int vm_shm_unlink(const char *name);
+
+/*
+ * vm_release() -- discard the contents of the pages lying wholly in the
+ * "len" bytes at "addr", e.g. free memory of an allocator.  The pages stay
+ * valid and read as zeros, but hold no physical page or disk space until
+ * they are written again.  Pages of shared segments are left alone.
+ * Returns 0 on success, -1 if the range is empty or not all valid.
+ */
+extern int vm_release(void *addr, unsigned int len);
+
+/*
+ * vm_advise() -- tell the pager how the pages overlapping the "len" bytes
+ * at "addr" will be used: VM_ADVISE_SEQUENTIAL (read in order, once; pages
+ * are read well ahead and dropped behind), VM_ADVISE_RANDOM (nothing is
+ * read ahead), VM_ADVISE_NORMAL (neither), VM_ADVISE_WILLNEED (read them
+ * in now) or VM_ADVISE_DONTNEED (evict them first, keeping their
+ * contents).  Returns 0 on success, -1 if the range is empty or not all
+ * valid, or the hint is unknown.
+ */
+extern int vm_advise(void *addr, unsigned int len, int hint);
+
 /* 
  * vm_syslog() -- ask external pager to log a message (message data must
  * be in address space controlled by external pager).  Logs message of length
@@ -8,6 +8,7 @@
 #define _VM_PAGER_H_
 
 #include <sys/types.h>
+#include "vm_advise.h"
 
 /*
  * ****************************************************
@@ -37,6 +38,18 @@ extern void vm_init(unsigned int memory_pages, unsigned int disk_blocks);
  */
 extern void vm_create(pid_t pid);
 
+/*
+ * vm_fork
+ *
+ * Called when the current process forks a child with process identifier
+ * "pid".  The child gets a copy of the current process's arena, which
+ * shares the parent's physical and disk pages until either process writes
+ * to them.  The child will only run when it's switched to via vm_switch().
+ * Should return 0 on success, -1 on failure (e.g. if there is not enough
+ * swap space for the copy).
+ */
+extern int vm_fork(pid_t pid);
+
 /*
  * vm_switch
  *
@@ -76,6 +89,63 @@ extern void vm_destroy();
  */
 extern void * vm_extend();
 
+/*
+ * vm_extend_n
+ *
+ * A request by current process to declare as valid the lowest "count"
+ * invalid virtual pages in the arena, as "count" calls to vm_extend would,
+ * but all or nothing.  It should return the lowest-numbered byte of the
+ * first new valid virtual page, or NULL, leaving the arena as it was, if
+ * count is 0, the pages do not fit in the arena, or the disk is out of swap
+ * space for all of them.
+ */
+extern void * vm_extend_n(unsigned int count);
+
+/*
+ * vm_shm_attach
+ *
+ * A request by current process to map the shared segment "name", of "pages"
+ * pages, just above the valid part of its arena, creating the segment if
+ * there is none by that name.  Every process attaching the segment sees the
+ * same pages, in the same physical pages: a write through one window is
+ * seen through all of them.  It should return the lowest-numbered byte of
+ * the window, or NULL on error, e.g., if the disk is out of swap space for
+ * a new segment, or the segment exists with another size.
+ */
+extern void * vm_shm_attach(const char *name, unsigned int pages);
+
+/*
+ * vm_shm_unlink
+ *
+ * A request by current process to remove the name of shared segment
+ * "name".  Processes attached to the segment keep it; it is freed when the
+ * last of them exits.  Should return 0 on success, -1 if there is no
+ * segment by that name.
+ */
+extern int vm_shm_unlink(const char *name);
+
+/*
+ * vm_release
+ *
+ * A request by current process to discard the contents of the pages lying
+ * wholly in the "len" bytes at "addr": their physical pages and disk blocks
+ * are freed, and the pages stay valid, reading as zeros on their next
+ * access.  Pages of windows onto shared segments are left alone.  Should
+ * return 0 on success, -1 if the range is empty or not all in the valid
+ * part of the arena.
+ */
+extern int vm_release(void *addr, unsigned int len);
+
+/*
+ * vm_advise
+ *
+ * A request by current process describing its use of the pages overlapping
+ * the "len" bytes at "addr", with one of the hints in vm_advise.h.
+ * Should return 0 on success, -1 if the range is empty or not all in the
+ * valid part of the arena, or the hint is unknown.
+ */
+extern int vm_advise(void *addr, unsigned int len, int hint);
+
 /*
  * vm_syslog
  *
@@ -110,6 +180,21 @@ extern void disk_read(unsigned int block, unsigned int ppage);
  */
 extern void disk_write(unsigned int block, unsigned int ppage);
 
+/*
+ * disk_readv, disk_writev
+ *
+ * Transfer "count" (block, ppage) pairs, like that many calls to disk_read or
+ * disk_write.  Runs of pairs with consecutive block numbers are transferred
+ * in one request, so callers should pass them in block order.
+ */
+typedef struct {
+    unsigned int block;
+    unsigned int ppage;
+} disk_iovec_t;
+
+extern void disk_readv(const disk_iovec_t *vec, unsigned int count);
+extern void disk_writev(const disk_iovec_t *vec, unsigned int count);
+
 /*
  * ********************************************************
  * * Public interface for the physical memory abstraction *
@@ -123,6 +208,17 @@ extern void disk_write(unsigned int block, unsigned int ppage);
  */
 extern void * pm_physmem;
 
+/*
+ * pm_shootdown
+ *
+ * Wait until no CPU (thread) is still accessing physical page "ppage"
+ * through a translation made before its page table entries were changed.
+ * A pager whose faults run on several threads calls it after revoking
+ * every mapping of a page, before it reads the page to write it back,
+ * compares it or reuses its frame.
+ */
+extern void pm_shootdown(unsigned int ppage);
+
 /*
  * ***********************
  * * Definition of arena *
@@ -172,7 +268,8 @@ typedef struct {
 /*
  * MMU's page table base register.  This variable is defined by the
  * infrastructure, but it is controlled completely by the student's pager code.
+ * Each thread calling into the pager is a CPU with its own register.
  */
-extern page_table_t *page_table_base_register;
+extern thread_local page_table_t *page_table_base_register;
 
 #endif /* _VM_PAGER_H_ */
@@ -0,0 +1,142 @@
+/*
+ * vm_sim.h
+ *
+ * In-process stand-in for the pager infrastructure (libvm_pager.a and
+ * libvm_app.a).  The simulator provides physical memory, the disk, the page
+ * table base register and an MMU inside a single 64-bit process, so the
+ * student pager can be driven directly by apps, tests and benchmarks
+ * without fork, signals between processes or IPC.
+ */
+
+#ifndef _VM_SIM_H_
+#define _VM_SIM_H_
+
+#include <sys/types.h>
+
+/*
+ * ***************************************
+ * * Physical memory and disk simulation *
+ * ***************************************
+ */
+
+/*
+ * pm_init
+ *
+ * Allocate "memory_pages" pages of physical memory and point pm_physmem at
+ * them.  Physical memory is backed by a memory file so that arena pages can
+ * be mapped onto physical pages by the host-backed MMU.
+ */
+extern void pm_init(unsigned int memory_pages);
+
+/* memory file backing pm_physmem, and its size in pages */
+extern int pm_fd;
+extern unsigned int pm_pages;
+
+/*
+ * disk_init
+ *
+ * Create a scratch disk of "disk_blocks" blocks.  The disk lives in an
+ * unlinked temporary file (in $TMPDIR, or /tmp).
+ */
+extern void disk_init(unsigned int disk_blocks);
+
+/*
+ * disk_open
+ *
+ * Use the file "path" as a disk of "disk_blocks" blocks instead, creating
+ * it if there is none, so that its blocks outlive the process (for a pager
+ * restarted with pager_state, see pager.h).
+ */
+extern void disk_open(const char *path, unsigned int disk_blocks);
+
+/* number of blocks read and written since disk_init */
+extern unsigned long long disk_reads;
+extern unsigned long long disk_writes;
+
+/* number of read and write requests to the disk file since disk_init */
+extern unsigned long long disk_requests;
+
+/*
+ * ***************************
+ * * MMU simulation (mmu.cc) *
+ * ***************************
+ */
+
+/*
+ * mmu_translate
+ *
+ * Software MMU.  Translate the arena address "addr" through
+ * page_table_base_register, calling vm_fault if the page table entry does
+ * not allow the access (a write needs write_enable, a read needs
+ * read_enable).  Returns the address of the byte in pm_physmem, or NULL if
+ * the address is outside the arena or vm_fault refused the access.
+ *
+ * The address stays valid only as long as nothing can revoke the access:
+ * the next call into the pager, or any moment while another thread may be
+ * in the pager (pager_threads, the cleaner, the dedup scanner or the
+ * warm-up), which can evict the page and hand its frame to another
+ * process.  Such drivers use mmu_read and mmu_write instead.
+ */
+extern void *mmu_translate(void *addr, bool write_flag);
+
+/*
+ * mmu_read, mmu_write
+ *
+ * Copy "len" bytes from the arena at "addr" into "buf", or from "buf" into
+ * the arena, faulting as mmu_translate does.  Each page is copied with its
+ * physical page pinned in the thread's TLB slot, which pm_shootdown waits
+ * for, so the copy is safe while other threads evict.  Return 0, or -1 if
+ * an address is outside the arena or vm_fault refused the access.
+ */
+extern int mmu_read(const void *addr, void *buf, size_t len);
+extern int mmu_write(void *addr, const void *buf, size_t len);
+
+/* number of faults raised by mmu_translate and by the host-backed arena */
+extern unsigned long long mmu_faults;
+
+/*
+ * mmu_attach
+ *
+ * Reserve the arena at VM_ARENA_BASEADDR in the host address space, so apps
+ * can dereference arena pointers directly.  Accesses the page table does
+ * not allow trap into the fault handler installed by the app scheduler.
+ */
+extern void mmu_attach();
+
+/*
+ * mmu_sync
+ *
+ * Bring the host mappings of the first "npages" arena pages in line with
+ * page_table_base_register.  Called after every call into the pager, since
+ * the pager may change any entry of the running process's page table (e.g.
+ * when it evicts one of its pages).
+ */
+extern void mmu_sync(unsigned int npages);
+
+/*
+ * mmu_flush
+ *
+ * Drop every host mapping of the arena, e.g. when switching to another
+ * process.
+ */
+extern void mmu_flush();
+
+/*
+ * *******************************
+ * * App scheduler (libpager.cc) *
+ * *******************************
+ */
+
+/*
+ * vm_app_run
+ *
+ * Run "copies" instances of the app linked into this binary
+ * (vm_app_main) as processes of the pager, round-robin on vm_yield().
+ * Returns the number of instances whose main returned non-zero.
+ */
+extern int vm_app_run(unsigned int copies);
+
+/* entry point of the app linked into this binary (the app's renamed main) */
+extern "C" int vm_app_main();
+
+#endif /* _VM_SIM_H_ */
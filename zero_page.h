@@ -0,0 +1,78 @@
+/*
+ * zero_page.h
+ *
+ * All-zero page check used by the pager before writing a page back.  On x86
+ * the check is vectorised, with AVX2 when the CPU has it and SSE2 otherwise;
+ * other targets use a scalar loop over 64-bit words.
+ */
+
+#ifndef _ZERO_PAGE_H_
+#define _ZERO_PAGE_H_
+
+#include <stdint.h>
+#include "vm_pager.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define ZERO_PAGE_X86
+#endif
+
+inline bool page_is_zero_scalar(const void* page)
+{
+    const uint64_t* p = (const uint64_t*) page;
+    uint64_t acc = 0;
+    for (unsigned int i = 0; i < VM_PAGESIZE / sizeof(uint64_t); i += 8) {
+        acc |= p[i] | p[i + 1] | p[i + 2] | p[i + 3] |
+               p[i + 4] | p[i + 5] | p[i + 6] | p[i + 7];
+        if (acc != 0)
+            return false;
+    }
+    return true;
+}
+
+#ifdef ZERO_PAGE_X86
+
+__attribute__((target("sse2")))
+inline bool page_is_zero_sse2(const void* page)
+{
+    const __m128i* p = (const __m128i*) page;
+    for (unsigned int i = 0; i < VM_PAGESIZE / sizeof(__m128i); i += 4) {
+        __m128i acc = _mm_or_si128(_mm_or_si128(_mm_load_si128(p + i), _mm_load_si128(p + i + 1)),
+                _mm_or_si128(_mm_load_si128(p + i + 2), _mm_load_si128(p + i + 3)));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(acc, _mm_setzero_si128())) != 0xffff)
+            return false;
+    }
+    return true;
+}
+
+__attribute__((target("avx2")))
+inline bool page_is_zero_avx2(const void* page)
+{
+    const __m256i* p = (const __m256i*) page;
+    for (unsigned int i = 0; i < VM_PAGESIZE / sizeof(__m256i); i += 4) {
+        __m256i acc = _mm256_or_si256(_mm256_or_si256(_mm256_load_si256(p + i), _mm256_load_si256(p + i + 1)),
+                _mm256_or_si256(_mm256_load_si256(p + i + 2), _mm256_load_si256(p + i + 3)));
+        if (!_mm256_testz_si256(acc, acc))
+            return false;
+    }
+    return true;
+}
+
+#endif /* ZERO_PAGE_X86 */
+
+/*
+ * True if the page-aligned page at "page" holds only zero bytes.  The
+ * implementation is picked on the first call.
+ */
+inline bool page_is_zero(const void* page)
+{
+#ifdef ZERO_PAGE_X86
+    static bool (*check)(const void*) =
+        __builtin_cpu_supports("avx2") ? page_is_zero_avx2 : page_is_zero_sse2;
+    return check(page);
+#else
+    return page_is_zero_scalar(page);
+#endif
+}
+
+#endif /* _ZERO_PAGE_H_ */